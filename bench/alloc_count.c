@@ -0,0 +1,51 @@
+/* Counts the heap allocations of the process it is preloaded into, used by suite.py.
+ * Every operator new of the simulators ends in malloc, so counting the glibc entry points is enough.
+ * The count and the peak RSS in kB (VmHWM, which unlike ru_maxrss does not include the parent that spawned
+ * the process) are written at exit to the file named by ALLOC_COUNT_OUT.
+ *
+ * build: cc -O2 -shared -fPIC -o alloc_count.so alloc_count.c
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+
+extern void *__libc_malloc(size_t size);
+extern void *__libc_calloc(size_t num, size_t size);
+extern void *__libc_realloc(void *ptr, size_t size);
+
+static atomic_long allocs;
+
+void *malloc(size_t size) {
+	atomic_fetch_add_explicit(&allocs, 1, memory_order_relaxed);
+	return __libc_malloc(size);
+}
+
+void *calloc(size_t num, size_t size) {
+	atomic_fetch_add_explicit(&allocs, 1, memory_order_relaxed);
+	return __libc_calloc(num, size);
+}
+
+void *realloc(void *ptr, size_t size) {
+	atomic_fetch_add_explicit(&allocs, 1, memory_order_relaxed);
+	return __libc_realloc(ptr, size);
+}
+
+__attribute__((destructor)) static void report(void) {
+	const char *out = getenv("ALLOC_COUNT_OUT");
+	long count = atomic_load(&allocs), hwm = 0;
+	char line[256];
+	FILE *f;
+	if(out == NULL)
+		return;
+	if((f = fopen("/proc/self/status", "r")) != NULL) {
+		while(fgets(line, sizeof(line), f) != NULL)
+			if(strncmp(line, "VmHWM:", 6) == 0)
+				hwm = atol(line + 6);
+		fclose(f);
+	}
+	if((f = fopen(out, "w")) == NULL)
+		return;
+	fprintf(f, "%ld %ld\n", count, hwm);
+	fclose(f);
+}
@@ -0,0 +1,51 @@
+#!/usr/bin/env python3
+# Compare the IO scheduling policies under every disk service time model.
+# Given a seed, requests without sector/size columns get random ones so rotation and transfer matter.
+#
+# usage: iosched_models.py <iosched binary> <input> [seed]
+import random
+import subprocess
+import sys
+import tempfile
+
+POLICIES = "ijscfad"
+MODELS = "lcrs"
+
+
+def add_columns(path, out, seed):
+    rng = random.Random(seed)
+    with open(path) as f:
+        for line in f:
+            if line.startswith("#") or len(line.split()) != 2:
+                out.write(line)
+            else:
+                out.write("%s %d %d\n" % (line.rstrip("\n"), rng.randrange(32), rng.randint(1, 8)))
+    out.flush()
+
+
+def summary(binary, infile, policy, model):
+    out = subprocess.run([binary, "-s" + policy, "-m" + model, infile],
+                         capture_output=True, text=True, check=True).stdout
+    for line in out.splitlines():
+        if line.startswith("SUM:"):
+            return line.split()[1:]
+    raise RuntimeError("no SUM line for -s%s -m%s" % (policy, model))
+
+
+def main():
+    if len(sys.argv) < 3:
+        sys.exit("usage: iosched_models.py <iosched binary> <input> [seed]")
+    binary, infile = sys.argv[1], sys.argv[2]
+    with tempfile.NamedTemporaryFile("w", suffix=".in") as tmp:
+        if len(sys.argv) > 3:
+            add_columns(infile, tmp, int(sys.argv[3]))
+            infile = tmp.name
+        print("%-5s %-4s %8s %8s %10s %10s %8s" % ("model", "alg", "time", "move", "avg_turn", "avg_wait", "max_wait"))
+        for model in MODELS:
+            for policy in POLICIES:
+                total, move, turn, wait, max_wait = summary(binary, infile, policy, model)
+                print("%-5s %-4s %8s %8s %10s %10s %8s" % (model, policy, total, move, turn, wait, max_wait))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,59 @@
+#!/usr/bin/env python3
+# Queue depth and throughput of the multi-queue block layer as submitters are added.
+# Every submitter issues its own Poisson stream of random requests, so offered load grows with the submitter count.
+#
+# usage: iosched_mq.py <iosched binary> [hw queues] [depth] [model] [requests per submitter] [mean gap] [seed]
+import random
+import subprocess
+import sys
+import tempfile
+
+SUBMITTERS = [1, 2, 4, 8, 16, 32]
+
+
+def write_input(f, submitters, count, gap, seed):
+    rng = random.Random(seed)
+    reqs = []
+    for cpu in range(submitters):
+        t = 0.0
+        for _ in range(count):
+            t += rng.expovariate(1.0 / gap)
+            reqs.append((int(t) + 1, rng.randrange(1000), rng.randrange(32), rng.randint(1, 8),
+                         "w" if rng.random() < 0.3 else "r", cpu))
+    reqs.sort()
+    f.write("# iosched_mq benchmark\n")
+    for r in reqs:
+        f.write("%d %d %d %d %s %d\n" % r)
+    f.flush()
+
+
+def run(binary, infile, submitters, hw, depth, model):
+    out = subprocess.run([binary, "-si", "-m" + model, "-q%d:%d:%d" % (submitters, hw, depth), infile],
+                         capture_output=True, text=True, check=True).stdout
+    fields = {}
+    for line in out.splitlines():
+        if line.startswith("SUM:") or line.startswith("MQ:"):
+            fields[line.split(":")[0]] = line.split()[1:]
+    return fields["SUM"], fields["MQ"]
+
+
+def main():
+    if len(sys.argv) < 2:
+        sys.exit("usage: iosched_mq.py <iosched binary> [hw queues] [depth] [model] [requests per submitter] [mean gap] [seed]")
+    binary = sys.argv[1]
+    hw = int(sys.argv[2]) if len(sys.argv) > 2 else 4
+    depth = int(sys.argv[3]) if len(sys.argv) > 3 else 32
+    model = sys.argv[4] if len(sys.argv) > 4 else "s"
+    count = int(sys.argv[5]) if len(sys.argv) > 5 else 2000
+    gap = float(sys.argv[6]) if len(sys.argv) > 6 else 20.0
+    seed = int(sys.argv[7]) if len(sys.argv) > 7 else 1
+    print("%-4s %10s %10s %10s %8s" % ("sub", "iops/1k", "avg_tags", "avg_wait", "max_tags"))
+    for submitters in SUBMITTERS:
+        with tempfile.NamedTemporaryFile("w", suffix=".in") as tmp:
+            write_input(tmp, submitters, count, gap, seed)
+            summary, mq = run(binary, tmp.name, submitters, hw, depth, model)
+            print("%-4d %10s %10s %10s %8s" % (submitters, mq[5], mq[3], summary[3], mq[4]))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,71 @@
+#!/usr/bin/env python3
+# Every pager on a trace whose processes keep forking and writing to the pages they share copy-on-write.
+# COW breaks move frames between owners, a pager that loses track of them hangs or crashes here.
+# Each run is given a time limit, the exit status is 1 when any pager failed or ran out of it.
+#
+# usage: pager_fork.py <mmu binary> <rfile> [instructions] [seed] [timeout]
+import random
+import subprocess
+import sys
+import tempfile
+
+PAGERS = "fsrncaAp"
+FRAMES = [4, 16, 48, 64]
+MAX_PROCS = 64
+
+
+def write_input(path, num_inst, seed):
+    rng = random.Random(seed)
+    procs = 1
+    cur = 0
+    with open(path, "w") as f:
+        f.write("# pager_fork benchmark\n1\n2\n0 31 0 0\n32 63 0 0\nc 0\n")
+        for _ in range(num_inst):
+            r = rng.random()
+            if r < 0.002 and procs < MAX_PROCS:
+                f.write("f %d\n" % cur)
+                procs += 1
+            elif r < 0.02:
+                cur = rng.randrange(procs)
+                f.write("c %d\n" % cur)
+            else:
+                vpage = rng.randrange(64) if rng.random() < 0.3 else rng.randrange(24)
+                f.write("%s %d\n" % ("w" if rng.random() < 0.4 else "r", vpage))
+
+
+def pager_faults(binary, infile, rfile, alg, frames, timeout):
+    try:
+        run = subprocess.run([binary, "-f%d" % frames, "-a" + alg, "-oS", infile, rfile],
+                             capture_output=True, text=True, timeout=timeout)
+    except subprocess.TimeoutExpired:
+        return "timeout"
+    if run.returncode != 0:
+        return "exit %d" % run.returncode
+    faults = 0
+    for line in run.stdout.splitlines():
+        if line.startswith("PROC["):
+            faults += int(line.split(" M=")[1].split()[0])
+    return faults
+
+
+def main():
+    if len(sys.argv) < 3:
+        sys.exit("usage: pager_fork.py <mmu binary> <rfile> [instructions] [seed] [timeout]")
+    binary, rfile = sys.argv[1], sys.argv[2]
+    num_inst = int(sys.argv[3]) if len(sys.argv) > 3 else 50000
+    seed = int(sys.argv[4]) if len(sys.argv) > 4 else 1
+    timeout = float(sys.argv[5]) if len(sys.argv) > 5 else 10
+    failed = 0
+    with tempfile.NamedTemporaryFile("w", suffix=".in") as tmp:
+        write_input(tmp.name, num_inst, seed)
+        print("%-4s" % "alg" + "".join("%10s" % ("f%d" % frames) for frames in FRAMES))
+        for alg in PAGERS:
+            row = [pager_faults(binary, tmp.name, rfile, alg, frames, timeout) for frames in FRAMES]
+            failed += sum(1 for faults in row if not isinstance(faults, int))
+            print("%-4s" % alg + "".join("%10s" % faults for faults in row))
+    if failed > 0:
+        sys.exit(1)
+
+
+if __name__ == "__main__":
+    main()
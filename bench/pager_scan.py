@@ -0,0 +1,115 @@
+#!/usr/bin/env python3
+# Page fault counts of every pager on a hot working set interleaved with large sequential scans.
+# LRU and OPT are computed here from the same trace as reference points.
+#
+# usage: pager_scan.py <mmu binary> <rfile> [frames] [instructions] [seed]
+import random
+import subprocess
+import sys
+import tempfile
+
+PAGERS = "fsrncaAp"
+
+
+def make_trace(num_inst, seed):
+    rng = random.Random(seed)
+    procs = 4
+    hot = [rng.sample(range(64), 6) for _ in range(procs)]
+    trace = []
+    cur = 0
+    i = 0
+    while i < num_inst:
+        if rng.random() < 0.01:
+            cur = rng.randrange(procs)
+            trace.append(("c", cur))
+            continue
+        if rng.random() < 0.005:  # one process scans its whole address space
+            for vpage in range(64):
+                trace.append(("r", vpage))
+            i += 64
+            continue
+        trace.append(("w" if rng.random() < 0.3 else "r", rng.choice(hot[cur])))
+        i += 1
+    return procs, trace
+
+
+def write_input(path, procs, trace):
+    with open(path, "w") as f:
+        f.write("# pager_scan benchmark\n%d\n" % procs)
+        for _ in range(procs):
+            f.write("1\n0 63 0 0\n")
+        f.write("c 0\n")
+        for instr, arg in trace:
+            f.write("%s %d\n" % (instr, arg))
+
+
+def references(trace):
+    refs = []
+    cur = 0
+    for instr, arg in trace:
+        if instr == "c":
+            cur = arg
+        else:
+            refs.append((cur, arg))
+    return refs
+
+
+def lru_faults(refs, frames):
+    resident = {}
+    faults = 0
+    for t, key in enumerate(refs):
+        if key not in resident:
+            faults += 1
+            if len(resident) == frames:
+                del resident[min(resident, key=resident.get)]
+        resident[key] = t
+    return faults
+
+
+def opt_faults(refs, frames):
+    next_use = [0] * len(refs)
+    last = {}
+    for t in range(len(refs) - 1, -1, -1):
+        next_use[t] = last.get(refs[t], len(refs))
+        last[refs[t]] = t
+    resident = {}
+    faults = 0
+    for t, key in enumerate(refs):
+        if key not in resident:
+            faults += 1
+            if len(resident) == frames:
+                del resident[max(resident, key=resident.get)]
+        resident[key] = next_use[t]
+    return faults
+
+
+def pager_faults(binary, infile, rfile, alg, frames):
+    out = subprocess.run([binary, "-f%d" % frames, "-a" + alg, "-oS", infile, rfile],
+                         capture_output=True, text=True, check=True).stdout
+    faults = 0
+    for line in out.splitlines():
+        if line.startswith("PROC["):
+            faults += int(line.split(" M=")[1].split()[0])
+    return faults
+
+
+def main():
+    if len(sys.argv) < 3:
+        sys.exit("usage: pager_scan.py <mmu binary> <rfile> [frames] [instructions] [seed]")
+    binary, rfile = sys.argv[1], sys.argv[2]
+    frames = int(sys.argv[3]) if len(sys.argv) > 3 else 32
+    num_inst = int(sys.argv[4]) if len(sys.argv) > 4 else 200000
+    seed = int(sys.argv[5]) if len(sys.argv) > 5 else 1
+    procs, trace = make_trace(num_inst, seed)
+    refs = references(trace)
+    with tempfile.NamedTemporaryFile("w", suffix=".in") as tmp:
+        write_input(tmp.name, procs, trace)
+        print("%-4s %10s" % ("alg", "faults"))
+        for alg in PAGERS:
+            print("%-4s %10d" % (alg, pager_faults(binary, tmp.name, rfile, alg, frames)))
+    print("%-4s %10d" % ("LRU", lru_faults(refs, frames)))
+    print("%-4s %10d" % ("OPT", opt_faults(refs, frames)))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,223 @@
+#!/usr/bin/env python3
+# Throughput benchmark of the four simulators on pinned synthetic inputs at several scales.
+# Every (simulator, algorithm, scale) point reports wall time, events per second, peak RSS and heap allocations
+# per event. The results can be written as JSON and compared against a stored baseline, the exit status is 1
+# when a point lost more than the tolerance in events per second.
+#
+# Events are requests for iosched, processes for sched, instructions for the VMM and instructions for the linker.
+# iosched and sched draw their workload from the built-in generator (-G), the VMM and linker inputs are written
+# from a fixed seed. The linker only takes programs up to its 512 word memory, so it runs at that size only.
+# Allocations and peak RSS are recorded by preloading alloc_count.c, built on the fly. Without it allocations are
+# reported as null and the RSS falls back to ru_maxrss, which includes the spawning interpreter.
+#
+# usage: suite.py [--bin <dir>] [--scales 1e3,1e4,1e5] [--repeat 3] [--only iosched,sched,mmu,linker]
+#                 [--json <out>] [--baseline <json>] [--tolerance 0.10]
+# Without --bin the simulators are built from the repository into a temporary directory, with -Wall -Werror so that
+# new warnings fail the suite.
+#
+# bench/baseline.json holds the results of "suite.py --json bench/baseline.json" at the default scales, with the
+# machine it was taken on. Events per second do not carry over between machines: before comparing changes, write a
+# baseline of the unchanged tree on the machine used, then run the changed tree with --baseline pointing at it.
+import argparse
+import json
+import os
+import platform
+import random
+import subprocess
+import sys
+import tempfile
+import time
+
+REPO = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+SOURCES = {"iosched": "iosched.cpp", "sched": "sched.cpp", "mmu": "main.cpp", "linker": "linker.cpp"}
+IOSCHED_ALGS = "ijscfadb"
+SCHED_ALGS = ["F", "L", "S", "R4", "P4"]
+PAGERS = "fsrncaAp"
+LINKER_WORDS = 512
+
+
+def build(workdir):
+    bindir = os.path.join(workdir, "bin")
+    os.makedirs(bindir)
+    for name, src in SOURCES.items():
+        subprocess.run(["g++", "-O2", "-std=c++17", "-Wall", "-Werror", "-pthread", "-o", os.path.join(bindir, name),
+                        os.path.join(REPO, src)], check=True)
+    return bindir
+
+
+def build_alloc_counter(workdir):
+    lib = os.path.join(workdir, "alloc_count.so")
+    try:
+        subprocess.run(["cc", "-O2", "-shared", "-fPIC", "-o", lib, os.path.join(REPO, "bench", "alloc_count.c")],
+                       check=True, capture_output=True)
+    except (OSError, subprocess.CalledProcessError):
+        return None
+    return lib
+
+
+def write_rfile(path, seed):
+    rng = random.Random(seed)
+    with open(path, "w") as f:
+        f.write("40000\n")
+        for _ in range(40000):
+            f.write("%d\n" % rng.randrange(1, 2 ** 31 - 1))
+
+
+def write_mmu_input(path, num_inst, seed):
+    rng = random.Random(seed)
+    procs = 4
+    hot = [rng.sample(range(64), 8) for _ in range(procs)]
+    with open(path, "w") as f:
+        f.write("# suite\n%d\n" % procs)
+        for _ in range(procs):
+            f.write("2\n0 31 0 0\n32 63 1 0\n")
+        f.write("c 0\n")
+        cur = 0
+        for _ in range(num_inst - 1):
+            if rng.random() < 0.01:
+                cur = rng.randrange(procs)
+                f.write("c %d\n" % cur)
+            else:
+                vpage = rng.choice(hot[cur]) if rng.random() < 0.8 else rng.randrange(64)
+                f.write("%s %d\n" % ("w" if rng.random() < 0.3 else "r", vpage))
+
+
+def write_linker_input(path, seed):
+    rng = random.Random(seed)
+    modules = LINKER_WORDS // 16
+    syms = ["S%d" % m for m in range(modules)]
+    with open(path, "w") as f:
+        for m in range(modules):
+            uses = rng.sample(syms, 4)
+            f.write("1 %s %d\n" % (syms[m], rng.randrange(16)))
+            f.write("%d %s\n" % (len(uses), " ".join(uses)))
+            code = []
+            for i in range(16):
+                kind = rng.choice("IAER")
+                if kind == "E":
+                    code.append("E %d" % (1000 * rng.randint(1, 9) + i % len(uses)))
+                elif kind == "A":
+                    code.append("A %d" % (1000 * rng.randint(1, 9) + rng.randrange(LINKER_WORDS)))
+                elif kind == "R":
+                    code.append("R %d" % (1000 * rng.randint(1, 9) + rng.randrange(16)))
+                else:
+                    code.append("I %d" % rng.randrange(10000))
+            f.write("16 %s\n" % " ".join(code))
+
+
+def measure(cmd, alloc_lib, workdir):
+    env = dict(os.environ)
+    count_file = os.path.join(workdir, "allocs")
+    if alloc_lib:
+        env["LD_PRELOAD"] = alloc_lib
+        env["ALLOC_COUNT_OUT"] = count_file
+    devnull = [(os.POSIX_SPAWN_OPEN, fd, os.devnull, os.O_WRONLY, 0) for fd in (1, 2)]
+    start = time.perf_counter()
+    pid = os.posix_spawn(cmd[0], cmd, env, file_actions=devnull)
+    _, status, usage = os.wait4(pid, 0)
+    wall = time.perf_counter() - start
+    code = os.waitstatus_to_exitcode(status)
+    if code != 0:
+        raise RuntimeError("%s exited with %d" % (" ".join(cmd), code))
+    # ru_maxrss also covers this interpreter, the process shared its memory until exec
+    allocs, rss = None, usage.ru_maxrss
+    if alloc_lib and os.path.exists(count_file):
+        with open(count_file) as f:
+            allocs, rss = [int(v) for v in f.read().split()]
+        os.remove(count_file)
+    return wall, rss, allocs
+
+
+def binary(bindir, name):
+    path = os.path.join(bindir, name)
+    if name == "mmu" and not os.path.exists(path):  # the VMM builds from main.cpp
+        path = os.path.join(bindir, "main")
+    return path
+
+
+def points(bindir, workdir, scales, only):
+    rfile = os.path.join(workdir, "rfile")
+    write_rfile(rfile, 1)
+    for scale in scales:
+        if "iosched" in only:
+            spec = "n=%d,gap=10,dist=zipf,size=4,writes=0.3,seed=1" % scale
+            for alg in IOSCHED_ALGS:
+                yield "iosched", alg, scale, [binary(bindir, "iosched"), "-s" + alg, "-ms", "-G" + spec]
+        if "sched" in only:
+            spec = "n=%d,gap=100,tc=200,cb=20,io=20,seed=1" % scale
+            for alg in SCHED_ALGS:
+                yield "sched", alg, scale, [binary(bindir, "sched"), "-s" + alg, "-G" + spec, rfile]
+        if "mmu" in only:
+            infile = os.path.join(workdir, "mmu.in")
+            write_mmu_input(infile, scale, 1)
+            for alg in PAGERS:
+                yield "mmu", alg, scale, [binary(bindir, "mmu"), "-f32", "-a" + alg, infile, rfile]
+    if "linker" in only:
+        infile = os.path.join(workdir, "linker.in")
+        write_linker_input(infile, 1)
+        yield "linker", "-", LINKER_WORDS, [binary(bindir, "linker"), infile]
+
+
+def compare(results, baseline, tolerance):
+    base = {(r["sim"], r["alg"], r["scale"]): r for r in baseline["results"]}
+    regressions = 0
+    print("\n%-8s %-4s %10s %12s %12s %8s" % ("sim", "alg", "scale", "base ev/s", "ev/s", "change"))
+    for r in results:
+        b = base.get((r["sim"], r["alg"], r["scale"]))
+        if b is None:
+            continue
+        change = r["events_per_s"] / b["events_per_s"] - 1.0
+        flag = ""
+        if change < -tolerance:
+            flag = " REGRESSION"
+            regressions += 1
+        print("%-8s %-4s %10d %12.0f %12.0f %+7.1f%%%s" % (r["sim"], r["alg"], r["scale"], b["events_per_s"],
+                                                           r["events_per_s"], 100 * change, flag))
+    return regressions
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Benchmark the simulators on pinned synthetic inputs.")
+    parser.add_argument("--bin", help="directory with the iosched, sched, mmu (or main) and linker binaries")
+    parser.add_argument("--scales", default="1e3,1e4,1e5", help="comma separated event counts")
+    parser.add_argument("--repeat", type=int, default=3, help="runs per point, the fastest is kept")
+    parser.add_argument("--only", default="iosched,sched,mmu,linker", help="simulators to run")
+    parser.add_argument("--json", help="write the results to this file")
+    parser.add_argument("--baseline", help="compare against results written earlier with --json")
+    parser.add_argument("--tolerance", type=float, default=0.10, help="allowed loss in events per second")
+    args = parser.parse_args()
+    scales = [int(float(s)) for s in args.scales.split(",")]
+    only = args.only.split(",")
+
+    results = []
+    with tempfile.TemporaryDirectory() as workdir:
+        bindir = args.bin or build(workdir)
+        alloc_lib = build_alloc_counter(workdir)
+        print("%-8s %-4s %10s %10s %12s %10s %10s" % ("sim", "alg", "scale", "wall_s", "ev/s", "rss_kb", "alloc/ev"))
+        for sim, alg, scale, cmd in points(bindir, workdir, scales, only):
+            runs = [measure(cmd, alloc_lib, workdir) for _ in range(max(args.repeat, 1))]
+            wall = min(r[0] for r in runs)
+            rss = max(r[1] for r in runs)
+            allocs = runs[0][2]
+            r = {"sim": sim, "alg": alg, "scale": scale, "events": scale, "wall_s": wall,
+                 "events_per_s": scale / wall if wall > 0 else 0.0, "peak_rss_kb": rss, "allocs": allocs,
+                 "allocs_per_event": allocs / scale if allocs is not None else None}
+            results.append(r)
+            print("%-8s %-4s %10d %10.3f %12.0f %10d %10s" % (sim, alg, scale, wall, r["events_per_s"], rss,
+                                                              "-" if allocs is None else "%.2f" % r["allocs_per_event"]))
+            sys.stdout.flush()
+
+    report = {"machine": {"platform": platform.platform(), "processor": platform.processor(),
+                          "python": platform.python_version()},
+              "scales": scales, "repeat": args.repeat, "results": results}
+    if args.json:
+        with open(args.json, "w") as f:
+            json.dump(report, f, indent=1)
+    if args.baseline:
+        with open(args.baseline) as f:
+            if compare(results, json.load(f), args.tolerance) > 0:
+                sys.exit(1)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,184 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <map>
+#include <functional>
+#include <iterator>
+#include <type_traits>
+using namespace std;
+
+//Binary checkpoints of the simulators
+//A checkpoint is a header (magic, simulator tag, format version) followed by the state in a fixed order. The same
+//snapshot code saves and restores: every field goes through io(), which writes it when saving and reads it back in
+//place when restoring, so the two directions cannot drift apart. Pointers are written as the number of the object
+//they point to (pid, frame, request id) and looked up again through an Index. A checkpoint is written beside its
+//file and renamed over it, so a crash while writing leaves the previous one intact.
+#define CHECKPOINT_MAGIC 0x54504b43
+#define CHECKPOINT_VERSION 1
+
+//Numbering of the objects a pointer may refer to
+template<class T>
+struct Index {
+	function<long(T*)> id_of;
+	function<T*(long)> at;
+};
+
+class Checkpoint {
+	public:
+		bool saving;
+		Checkpoint(string path, bool save, char tag);
+		void close();
+		void fail(const char* why);
+		template<class T>
+		void io(T &v);
+		template<class T>
+		void io(vector<T> &v);
+		template<class T>
+		void ref(T* &p, Index<T> &index);
+		//Sequence of plain values (list, deque)
+		template<class C>
+		void items(C &c);
+		//Sequence of pointers (vector, list, deque)
+		template<class C, class T>
+		void refs(C &c, Index<T> &index);
+		//Map or multimap of pointers, equal keys keep their order
+		template<class M, class T>
+		void keyed_refs(M &m, Index<T> &index);
+		//Iterator into c as its position, end() as -1
+		template<class C, class It>
+		void pos(C &c, It &it);
+	private:
+		FILE* file;
+		string path, tmp;
+};
+
+Checkpoint::Checkpoint(string path, bool save, char tag) : saving(save), path(path) {
+	tmp = path + ".tmp";
+	file = fopen(save ? tmp.c_str() : path.c_str(), save ? "wb" : "rb");
+	if(file == NULL)
+		fail("cannot open");
+	int magic = CHECKPOINT_MAGIC, version = CHECKPOINT_VERSION;
+	char kind = tag;
+	io(magic);
+	io(version);
+	io(kind);
+	if(magic != CHECKPOINT_MAGIC)
+		fail("not a checkpoint");
+	if(version != CHECKPOINT_VERSION)
+		fail("written by another version");
+	if(kind != tag)
+		fail("written by another simulator");
+}
+
+void Checkpoint::close() {
+	if(saving) {
+		if(fclose(file) != 0 || rename(tmp.c_str(), path.c_str()) != 0)
+			fail("cannot write");
+	}
+	else
+		fclose(file);
+	file = NULL;
+}
+
+void Checkpoint::fail(const char* why) {
+	fprintf(stderr, "checkpoint %s: %s\n", path.c_str(), why);
+	exit(1);
+}
+
+template<class T>
+void Checkpoint::io(T &v) {
+	static_assert(is_trivially_copyable<T>::value, "io() copies the bytes of the object");
+	if(saving ? fwrite(&v, sizeof(T), 1, file) != 1 : fread(&v, sizeof(T), 1, file) != 1)
+		fail(saving ? "cannot write" : "truncated");
+}
+
+template<class T>
+void Checkpoint::io(vector<T> &v) {
+	static_assert(is_trivially_copyable<T>::value, "io() copies the bytes of the elements");
+	long n = v.size();
+	io(n);
+	if(saving) {
+		if(n > 0 && fwrite(v.data(), sizeof(T), n, file) != (size_t)n)
+			fail("cannot write");
+		return;
+	}
+	vector<char> raw(n * sizeof(T)); //T need not be default constructible
+	if(n > 0 && fread(raw.data(), sizeof(T), n, file) != (size_t)n)
+		fail("truncated");
+	v.assign((T*)raw.data(), (T*)raw.data() + n);
+}
+
+template<class T>
+void Checkpoint::ref(T* &p, Index<T> &index) {
+	long id = saving && p != NULL ? index.id_of(p) : -1;
+	io(id);
+	if(!saving)
+		p = id < 0 ? NULL : index.at(id);
+}
+
+template<class C>
+void Checkpoint::items(C &c) {
+	vector<typename C::value_type> v(c.begin(), c.end());
+	io(v);
+	if(!saving)
+		c.assign(v.begin(), v.end());
+}
+
+template<class C, class T>
+void Checkpoint::refs(C &c, Index<T> &index) {
+	long n = c.size();
+	io(n);
+	if(saving) {
+		for(T* p : c)
+			ref(p, index);
+		return;
+	}
+	c.clear();
+	for(long i = 0; i < n; i++) {
+		T* p;
+		ref(p, index);
+		c.push_back(p);
+	}
+}
+
+template<class M, class T>
+void Checkpoint::keyed_refs(M &m, Index<T> &index) {
+	long n = m.size();
+	io(n);
+	if(saving) {
+		for(auto &entry : m) {
+			typename M::key_type key = entry.first;
+			T* p = entry.second;
+			io(key);
+			ref(p, index);
+		}
+		return;
+	}
+	m.clear();
+	for(long i = 0; i < n; i++) {
+		typename M::key_type key;
+		T* p;
+		io(key);
+		ref(p, index);
+		m.insert(m.end(), make_pair(key, p));
+	}
+}
+
+template<class C, class It>
+void Checkpoint::pos(C &c, It &it) {
+	long n = saving ? (it == c.end() ? -1 : distance(c.begin(), It(it))) : 0;
+	io(n);
+	if(!saving) {
+		it = c.begin();
+		if(n < 0)
+			it = c.end();
+		else
+			advance(it, n);
+	}
+}
+
+#endif
@@ -4,289 +4,339 @@
 #include <cstdlib>
 #include <unistd.h>
 #include <vector>
+#include <deque>
+#include <map>
+#include <algorithm>
 #include <cmath>
 #include <climits> 
+#include "iosched.h"
+#include "workload.h"
 using namespace std;
+using namespace iosched;
 
-struct IOrequest{
+#define MQ_BATCH 8 //requests moved from one software queue to its hardware queue at a time
+#define MAX_MERGE 64 //sectors a merged request may grow to
+
+//Request front end: plugging and merging ahead of the scheduling policy
+//Pending requests (plugged or queued, not dispatched) are indexed by their first and one-past-last block address.
+//A new request that continues one of them (back merge) or ends where one starts on the same track (front merge)
+//is absorbed into it and completes with it. Only requests of the same direction and tenant merge, so no tenant is
+//served and charged in the queue of another. Plugged requests are held until the plug is plug_ticks old, then
+//handed to the policy in block order.
+class FrontEnd {
 	public:
-		int arrival_time;
-		int start_time;
-		int end_time;
-		int index;
-		int track;
-		IOrequest(int id, int timeStep, int trackNum);
+		int back_merges, front_merges, unplugs;
+		FrontEnd(IOScheduler* IOsche, bool merging, int plug_ticks);
+		void submit(IOrequest* IOreq, int now);
+		void unplug(int now);
+		void dispatched(IOrequest* IOreq);
+		bool plugged();
+		void checkpoint(Checkpoint &ck, Index<IOrequest> &reqs);
+	private:
+		IOScheduler* IOsche;
+		bool merging;
+		int plug_ticks, plug_start;
+		vector<IOrequest*> plug;
+		map<long, IOrequest*> by_start, by_end;
+		void index(IOrequest* IOreq);
+		void unindex(IOrequest* IOreq);
 };
 
-IOrequest::IOrequest(int id, int timeStep, int trackNum) {
-	index = id;
-	arrival_time = timeStep;
-	track = trackNum;
-	start_time = 0;
-	end_time = 0;
+long block(int track, int sector) {
+	return (long)track * SECTORS_PER_TRACK + sector;
 }
- 
-class IOScheduler {
-	public:
-		IOScheduler();
-		virtual void addIOrequest(IOrequest* IOreq) {}
-		virtual	IOrequest* getIOrequest(int cur_track) {}
-};
 
-IOScheduler::IOScheduler() {
-	
+bool mergeable(IOrequest* pending, IOrequest* IOreq) {
+	return pending->write == IOreq->write && pending->tenant == IOreq->tenant && pending->weight == IOreq->weight
+			&& pending->size + IOreq->size <= MAX_MERGE;
 }
 
-//First In First Out
-class FIFO : public IOScheduler {
-	public:
-		FIFO();
-		void addIOrequest(IOrequest* IOreq);
-		IOrequest* getIOrequest(int cur_track);
-	private:
-		vector<IOrequest*> queue;
-}; 
+FrontEnd::FrontEnd(IOScheduler* IOsche, bool merging, int plug_ticks) : IOsche(IOsche), merging(merging), plug_ticks(plug_ticks) {
+	back_merges = 0;
+	front_merges = 0;
+	unplugs = 0;
+	plug_start = 0;
+}
 
-FIFO::FIFO() {
-	
+void FrontEnd::index(IOrequest* IOreq) {
+	by_start.insert(make_pair(block(IOreq->track, IOreq->sector), IOreq)); //The first of several at one address keeps it
+	by_end.insert(make_pair(block(IOreq->track, IOreq->sector) + IOreq->size, IOreq));
 }
 
-void FIFO::addIOrequest(IOrequest* IOreq) {
-	queue.push_back(IOreq);
+void FrontEnd::unindex(IOrequest* IOreq) {
+	auto start = by_start.find(block(IOreq->track, IOreq->sector));
+	if(start != by_start.end() && start->second == IOreq)
+		by_start.erase(start);
+	auto end = by_end.find(block(IOreq->track, IOreq->sector) + IOreq->size);
+	if(end != by_end.end() && end->second == IOreq)
+		by_end.erase(end);
 }
 
-IOrequest* FIFO::getIOrequest(int cur_track) {
-	if(!queue.empty()) {
-		IOrequest* IOreq = queue.front();
-		queue.erase(queue.begin());
-		return IOreq;
-	} 
+void FrontEnd::submit(IOrequest* IOreq, int now) {
+	if(merging) {
+		long start = block(IOreq->track, IOreq->sector), end = start + IOreq->size;
+		auto back = by_end.find(start);
+		if(back != by_end.end() && mergeable(back->second, IOreq)) {
+			IOrequest* pending = back->second;
+			unindex(pending);
+			pending->size += IOreq->size;
+			pending->merged.push_back(IOreq);
+			index(pending);
+			back_merges++;
+			return;
+		}
+		auto front = by_start.find(end);
+		if(front != by_start.end() && front->second->track == IOreq->track && mergeable(front->second, IOreq)) {
+			IOrequest* pending = front->second;
+			unindex(pending);
+			pending->sector = IOreq->sector;
+			pending->size += IOreq->size;
+			pending->merged.push_back(IOreq);
+			index(pending);
+			front_merges++;
+			return;
+		}
+		index(IOreq);
+	}
+	if(plug_ticks > 0) {
+		if(plug.empty())
+			plug_start = now;
+		plug.push_back(IOreq);
+	}
 	else
-		return NULL;
-} 
+		IOsche->addIOrequest(IOreq);
+}
 
-//Shortest Seek Time First
-class SSTF : public IOScheduler {
-	public:
-		SSTF();	
-		void addIOrequest(IOrequest* IOreq);
-		IOrequest* getIOrequest(int cur_track);
-	private:
-		vector<IOrequest*> queue;
-};
+void FrontEnd::unplug(int now) {
+	if(plug.empty() || now - plug_start < plug_ticks)
+		return;
+	sort(plug.begin(), plug.end(), [](IOrequest* a, IOrequest* b) {
+		return block(a->track, a->sector) < block(b->track, b->sector);
+	});
+	for(auto IOreq : plug)
+		IOsche->addIOrequest(IOreq);
+	plug.clear();
+	unplugs++;
+}
 
-SSTF::SSTF() {
-	
+void FrontEnd::dispatched(IOrequest* IOreq) {
+	if(merging)
+		unindex(IOreq);
 }
 
-void SSTF::addIOrequest(IOrequest* IOreq) {
-	queue.push_back(IOreq);
+bool FrontEnd::plugged() {
+	return !plug.empty();
 }
 
-IOrequest* SSTF::getIOrequest(int cur_track) {
-	if(!queue.empty()) {
-		IOrequest* sstio;
-		int min = INT_MAX, id = 0;
-		for(int i = 0; i < queue.size(); i++) {
-			IOrequest* temp = queue[i];
-			if(abs(temp->track - cur_track) < min) {
-				min = abs(temp->track - cur_track);
-				sstio = temp;
-				id = i;
-			}
-		}
-		queue.erase(queue.begin() + id);
-		return sstio;
-	}
-	else
-		return NULL;
+void FrontEnd::checkpoint(Checkpoint &ck, Index<IOrequest> &reqs) {
+	ck.io(back_merges);
+	ck.io(front_merges);
+	ck.io(unplugs);
+	ck.io(plug_start);
+	ck.refs(plug, reqs);
+	ck.keyed_refs(by_start, reqs);
+	ck.keyed_refs(by_end, reqs);
 }
 
-//No end looking SCAN
-class LOOK : public IOScheduler {
+//Where the requests come from
+//A trace source walks the requests read from the input file. A generated source draws them one at a time from a
+//workload spec and deletes them once they complete, so the memory in use is bounded by the requests in flight.
+class RequestSource {
 	public:
-		LOOK();
-		void addIOrequest(IOrequest* IOreq);
-		IOrequest* getIOrequest(int cur_track);
-	private:
-		int dir;
-		vector<IOrequest*> queue;
+		RequestSource();
+		virtual IOrequest* peek() { return NULL; } //next arrival, NULL if none is known yet
+		virtual void pop() {}
+		virtual bool done() { return true; } //no further arrivals will come
+		virtual void completed(IOrequest* IOreq, int now) {}
+		//Saves or restores the position in the arrivals
+		virtual void checkpoint(Checkpoint &ck);
 };
 
-LOOK::LOOK() {
-	dir = 1; //The initial direction is from 0-tracks to higher tracks
+RequestSource::RequestSource() {
 }
 
-void LOOK::addIOrequest(IOrequest* IOreq) {
-	queue.push_back(IOreq); 
+void RequestSource::checkpoint(Checkpoint &ck) {
+	ck.fail("checkpoints replay an input file, they do not cover generated workloads");
 }
 
-IOrequest* LOOK::getIOrequest(int cur_track) {
-	if(!queue.empty()) {
-		IOrequest* lookio = NULL;
-		int min = INT_MAX, id = 0;
-		for(int i = 0; i < queue.size(); i++) {
-			IOrequest* temp = queue[i];
-			if(dir == 1) {
-				int dis = temp->track - cur_track;
-				if(dis >= 0 && dis < min) { //dis >= 0 in case that two IOs have same track number
-					min = dis;
-					lookio = temp;
-					id = i;
-				}
-			}
-			if(dir == -1) {
-				int dis = cur_track - temp->track;
-				if(dis >= 0 && dis < min) {
-					min = dis;
-					lookio = temp;
-					id = i;
-				}
-			}
-		}
-		if(lookio == NULL) {
-			dir = -dir; //No proper outIO, reverse the direction
-			lookio = getIOrequest(cur_track);
-		}
-		else { //Don't want to erase innocent IOs
-			queue.erase(queue.begin() + id);
-		}
-		return lookio;
-	} 
-	else
-		return NULL;
-}
-
-//No end looking C-SCAN
-class CLOOK : public IOScheduler {
+class TraceSource : public RequestSource {
 	public:
-		CLOOK();
-		void addIOrequest(IOrequest* IOreq);
-		IOrequest* getIOrequest(int cur_track);
+		TraceSource(vector<IOrequest*>* IO_list);
+		IOrequest* peek();
+		void pop();
+		bool done();
+		void checkpoint(Checkpoint &ck);
 	private:
-		vector<IOrequest*> queue;
+		vector<IOrequest*>* list;
+		int next;
 };
 
-CLOOK::CLOOK() {
-	
+TraceSource::TraceSource(vector<IOrequest*>* IO_list) {
+	list = IO_list;
+	next = 0;
 }
 
-void CLOOK::addIOrequest(IOrequest* IOreq) {
-	queue.push_back(IOreq);
+IOrequest* TraceSource::peek() {
+	return next < (int)list->size() ? (*list)[next] : NULL;
 }
 
-IOrequest* CLOOK::getIOrequest(int cur_track) {
-	if(!queue.empty()) {
-		IOrequest* clookio = NULL;
-		int min = INT_MAX, id = 0;
-		//From lower to higher, find the min IO
-		for(int i = 0; i < queue.size(); i++) {
-			IOrequest* temp = queue[i];
-			int dis = temp->track - cur_track;
-			if(dis >= 0 && dis < min) {
-				min = dis;
-				clookio = temp;
-				id = i;
-			}
-		}
-		if(clookio == NULL) { //Returns back to the beginning
-			cur_track = 0;
-			clookio = getIOrequest(cur_track);
-		}
-		else
-			queue.erase(queue.begin() + id);
-		return clookio;
-	}
-	else {
-		return NULL;	
-	}
+void TraceSource::pop() {
+	next++;
 }
 
-//LOOK with two queues
-class FLOOK : public IOScheduler {
+bool TraceSource::done() {
+	return next >= (int)list->size();
+}
+
+void TraceSource::checkpoint(Checkpoint &ck) {
+	ck.io(next);
+}
+
+//Workload keys of the IO scheduler on top of the generator's own: tracks on the disk, maximum request size in sectors
+//and the fraction of writes. Open loop requests come from CPU id, closed loop requests from their client.
+class GeneratedSource : public RequestSource {
 	public:
-		FLOOK();
-		void addIOrequest(IOrequest* IOreq);
-		IOrequest* getIOrequest(int cur_track);		
+		GeneratedSource(string spec);
+		IOrequest* peek();
+		void pop();
+		bool done();
+		void completed(IOrequest* IOreq, int now);
 	private:
-		//Use two queues add to one, retrieve from the other, when empty flip the pointers
-		int dir;
-		vector<IOrequest*> proc_queue;
-		vector<IOrequest*> wait_queue;
+		Workload* workload;
+		IOrequest* pending;
+		int id, tracks, max_size;
+		double writes;
 };
 
-FLOOK::FLOOK() {
-	dir = 1;
+GeneratedSource::GeneratedSource(string spec) {
+	workload = new Workload(spec);
+	pending = NULL;
+	id = 0;
+	tracks = (int)workload->get("tracks", 512.0);
+	max_size = max((int)workload->get("size", 1.0), 1);
+	writes = workload->get("writes", 0.0);
 }
 
-void FLOOK::addIOrequest(IOrequest* IOreq) {
-	wait_queue.push_back(IOreq);
+IOrequest* GeneratedSource::peek() {
+	if(pending != NULL || workload->generated >= workload->count)
+		return pending;
+	long time;
+	int cpu = id;
+	if(workload->closed) {
+		if(!workload->client_pending())
+			return NULL;
+		pair<long, int> next = workload->next_client();
+		time = next.first;
+		cpu = next.second;
+	}
+	else
+		time = workload->next_arrival();
+	int size = workload->uniform(1, max_size);
+	long block = workload->sample((long)tracks * SECTORS_PER_TRACK, size);
+	pending = new IOrequest(id, (int)time, block / SECTORS_PER_TRACK, block % SECTORS_PER_TRACK, size);
+	pending->write = workload->chance(writes);
+	pending->cpu = cpu;
+	id++;
+	return pending;
 }
 
-IOrequest* FLOOK::getIOrequest(int cur_track) {
-	if(proc_queue.empty()) {
-		proc_queue = wait_queue;
-		wait_queue.clear();
-	}
-	//proc_queue is empty on first access, so switch the queues
-	if(!proc_queue.empty()) {
-		IOrequest* flookio = NULL;
-		int min = INT_MAX, id = 0;
-		//continue in the direction you were going from the current position
-		for(int i = 0; i < proc_queue.size(); i++) {
-			IOrequest* temp = proc_queue[i];
-			if(dir == 1) {
-				int dis = temp->track - cur_track;
-				if(dis >= 0 && dis < min) {
-					min = dis;
-					flookio = temp;
-					id = i;
-				}
-			}
-			if(dir == -1) {
-				int dis = cur_track - temp->track;
-				if(dis >= 0 && dis < min) {
-					min = dis;
-					flookio = temp;
-					id = i;
-				}
-			}
-		}
-		//then switch direction until empty 
-		if(flookio == NULL && !proc_queue.empty()) {
-			dir = -dir;
-			flookio = getIOrequest(cur_track);
-		}
-		else {
-			proc_queue.erase(proc_queue.begin() + id);
-		}
-		return flookio;
+void GeneratedSource::pop() {
+	pending = NULL;
+}
+
+bool GeneratedSource::done() {
+	return pending == NULL && workload->generated >= workload->count;
+}
+
+void GeneratedSource::completed(IOrequest* IOreq, int now) {
+	for(auto r : IOreq->merged) {
+		if(workload->closed)
+			workload->client_ready(r->cpu, now);
+		delete r;
 	}
-	else
-		return NULL;
+	if(workload->closed)
+		workload->client_ready(IOreq->cpu, now);
+	delete IOreq;
 }
 
 class Simulator {
 	public:
-		int id, total_time, tot_movement, max_waittime, total_turnaround, total_waittime;
+		int id, total_time, max_waittime;
+		long tot_movement, num_started;
+		long long total_turnaround, total_waittime;
+		long rw_count[2], rw_wait[2]; //by direction, read and write
+		int rw_max[2];
 		double avg_turnaround, avg_waittime;
-		IOScheduler* IOsche;
+		DiskModel* disk;
 		vector<IOrequest*> IO_list;
+		string workload_spec; //generate the requests instead of reading them
+		RequestSource* source;
+		bool merging;
+		bool tenants; //the input names tenants
+		int plug_ticks;
+		vector<FrontEnd*> fronts;
+		string checkpoint_file, restore_file;
+		int checkpoint_every; //ticks between two checkpoints, 0 for none
 		
 		Simulator();
 		void readInputFile(string infile);
-		void scheduling(string infile, string scheAlg);
+		void openSource(string infile);
+		void scheduling(string infile, string scheAlg, string diskModel);
+		void scheduling_mq(string infile, string scheAlg, string diskModel, int num_sw, int num_hw, int depth);
+		template<class Policy>
+		void run(Policy* IOsche);
+		template<class Policy, class Make>
+		void run_mq(Policy* first, Make make, int num_sw, int num_hw, int depth);
+		void printSummary();
+		void start(IOrequest* IOreq, int trackAt, int simTime);
+	private:
+		char alg;
+		template<class Policy>
+		void snapshot(Checkpoint &ck, Policy* IOsche, FrontEnd* front, int &simTime, int &trackAt, IOrequest* &cur_IOreq);
 };
 
 Simulator::Simulator() {
 	id = 0;
 	total_time = 0;
 	tot_movement = 0;
+	num_started = 0;
+	for(int w = 0; w < 2; w++) {
+		rw_count[w] = 0;
+		rw_wait[w] = 0;
+		rw_max[w] = 0;
+	}
 	max_waittime = 0;
 	total_turnaround = 0;
 	total_waittime = 0;
 	avg_turnaround = 0;
 	avg_waittime = 0;
+	merging = false;
+	tenants = false;
+	plug_ticks = 0;
+	checkpoint_every = 0;
+	alg = 0;
+}
+
+//Start serving a request, the requests merged into it are served along
+void Simulator::start(IOrequest* IOreq, int trackAt, int simTime) {
+	IOreq->start_time = simTime;
+	IOreq->end_time = simTime + disk->service_time(trackAt, IOreq, simTime); //No SCAN
+	tot_movement += abs(trackAt - IOreq->track);
+	for(int i = -1; i < (int)IOreq->merged.size(); i++) {
+		IOrequest* r = i < 0 ? IOreq : IOreq->merged[i];
+		r->start_time = IOreq->start_time;
+		r->end_time = IOreq->end_time;
+		num_started++;
+		total_turnaround += (r->end_time - r->arrival_time);
+		int wait_time = (r->start_time - r->arrival_time);
+		total_waittime += wait_time;
+		if(wait_time > max_waittime)
+			max_waittime = wait_time;
+		rw_count[r->write]++;
+		rw_wait[r->write] += wait_time;
+		if(wait_time > rw_max[r->write])
+			rw_max[r->write] = wait_time;
+	}
 }
 
 void Simulator::readInputFile(string infile) {
@@ -296,47 +346,110 @@ void Simulator::readInputFile(string infile) {
 	while(getline(input, line)) {
 		if(line[0] != '#') {
 			stringstream split(line);
-			int timeStep, trackNum;
+			int timeStep, trackNum, sectorNum, numSectors, cpu, tenant, weight;
+			char rw;
 			split >> timeStep >> trackNum;
-			IO_list.push_back(new IOrequest(id, timeStep, trackNum));
+			if(!(split >> sectorNum)) //Optional sector, size and r/w columns
+				sectorNum = 0;
+			if(!(split >> numSectors))
+				numSectors = 1;
+			if(!(split >> rw))
+				rw = 'r';
+			if(!(split >> cpu)) //Optional submitter for the multi-queue mode, round robin otherwise
+				cpu = id;
+			if(!(split >> tenant)) //Optional tenant and its weight
+				tenant = 0;
+			else
+				tenants = true;
+			if(!(split >> weight))
+				weight = 1;
+			IOrequest* IOreq = new IOrequest(id, timeStep, trackNum, sectorNum, numSectors);
+			IOreq->write = (rw == 'w');
+			IOreq->tenant = tenant;
+			IOreq->weight = weight;
+			IOreq->cpu = cpu;
+			IO_list.push_back(IOreq);
 			id++;
 		}
 	}
 }
 
-void Simulator::scheduling(string infile, string scheAlg) {
-	readInputFile(infile);
-	//Choose IO scheduler
-	char alg = scheAlg[0];
-	if(alg == 'i')
-		IOsche = new FIFO();
-	if(alg == 'j')
-		IOsche = new SSTF();
-	if(alg == 's')
-		IOsche = new LOOK();
-	if(alg == 'c')
-		IOsche = new CLOOK();
-	if(alg == 'f')
-		IOsche = new FLOOK();
+void Simulator::openSource(string infile) {
+	if(workload_spec.empty()) {
+		readInputFile(infile);
+		source = new TraceSource(&IO_list);
+	}
+	else
+		source = new GeneratedSource(workload_spec);
+}
+
+//One dispatch on the policy, the simulation loops are instantiated per policy
+void Simulator::scheduling(string infile, string scheAlg, string diskModel) {
+	if(!workload_spec.empty() && (checkpoint_every > 0 || !restore_file.empty())) {
+		fprintf(stderr, "checkpoints replay an input file, they do not cover generated workloads\n");
+		exit(1);
+	}
+	openSource(infile);
+	alg = scheAlg.empty() ? 0 : scheAlg[0];
+	disk = newDiskModel(diskModel[0]);
+	if(!dispatchIOScheduler(scheAlg.empty() ? 0 : scheAlg[0], disk, [&](auto IOsche) { run(IOsche); })) {
+		fprintf(stderr, "Unknown IO scheduler '%s'\n", scheAlg.c_str());
+		exit(1);
+	}
+}
+
+void Simulator::scheduling_mq(string infile, string scheAlg, string diskModel, int num_sw, int num_hw, int depth) {
+	if(checkpoint_every > 0 || !restore_file.empty()) {
+		fprintf(stderr, "checkpoints do not cover the multi-queue mode\n");
+		exit(1);
+	}
+	openSource(infile);
+	disk = newDiskModel(diskModel[0]);
+	alg = scheAlg.empty() ? 0 : scheAlg[0];
+	bool known = dispatchIOScheduler(alg, disk, [&](auto first) {
+		//The other software queues are built the same way, a copy would share the iterators of the first
+		run_mq(first, [&]() { return static_cast<decltype(first)>(newIOScheduler(alg, disk)); }, num_sw, num_hw, depth);
+	});
+	if(!known) {
+		fprintf(stderr, "Unknown IO scheduler '%s'\n", scheAlg.c_str());
+		exit(1);
+	}
+}
+
+template<class Policy>
+void Simulator::run(Policy* IOsche) {
+	FrontEnd* front = new FrontEnd(IOsche, merging, plug_ticks);
+	fronts.push_back(front);
 	
-	int simTime = 0, trackAt = 0, num_IOreq = 0;
+	int simTime = 0, trackAt = 0;
 	IOrequest* cur_IOreq = NULL;
-	while(num_IOreq < IO_list.size() || cur_IOreq != NULL) {
+	IOrequest* newIO;
+	if(!restore_file.empty()) {
+		Checkpoint ck(restore_file, false, 'I');
+		snapshot(ck, IOsche, front, simTime, trackAt, cur_IOreq);
+		ck.close();
+	}
+	int resumed_at = simTime;
+	while(!source->done() || cur_IOreq != NULL || front->plugged() || IOsche->idling()) {
+		if(checkpoint_every > 0 && simTime % checkpoint_every == 0 && simTime != resumed_at) {
+			Checkpoint ck(checkpoint_file, true, 'I');
+			snapshot(ck, IOsche, front, simTime, trackAt, cur_IOreq);
+			ck.close();
+		}
 		simTime++; //Increment
 		//1) Did a new I/O arrive to the system at this time, if so add to IO-queue
-		if(num_IOreq < IO_list.size()) {
-			IOrequest* newIO = IO_list[num_IOreq];
-			if(newIO != NULL && newIO->arrival_time == simTime) {
-				IOsche->addIOrequest(newIO);
-				num_IOreq++;
-			}
+		while((newIO = source->peek()) != NULL && newIO->arrival_time <= simTime) {
+			front->submit(newIO, simTime);
+			source->pop();
 		}
+		front->unplug(simTime);
 		
 		//2) Is an IO active and completed at this time
 		//if(cur_IOreq != NULL) cout<<cur_IOreq->end_time<<"  "<<simTime<<endl;
 		if(cur_IOreq != NULL && cur_IOreq->end_time == simTime) {
 			total_time = simTime;
 			trackAt = cur_IOreq->track;
+			source->completed(cur_IOreq, simTime);
 			cur_IOreq = NULL;
 		}
 		
@@ -348,42 +461,251 @@ void Simulator::scheduling(string infile, string scheAlg) {
 		//4) Is no IO request active now (after (2)) but IO requests are pending? Fetch and start a new IO.
 		if(cur_IOreq == NULL) {
 			//Fetch
+			IOsche->cur_time = simTime;
 			cur_IOreq = IOsche->getIOrequest(trackAt);
 			if(cur_IOreq == NULL) //DON'T miss NULL cases
 				continue;
+			front->dispatched(cur_IOreq);
 			//Start
-			cur_IOreq->start_time = simTime;
-			int move_time = abs(trackAt - cur_IOreq->track); //No SCAN
-			cur_IOreq->end_time = simTime + move_time;
-			tot_movement += move_time;
-			total_turnaround += (cur_IOreq->end_time - cur_IOreq->arrival_time);
-			int wait_time = (cur_IOreq->start_time - cur_IOreq->arrival_time);
-			total_waittime += wait_time;
-			if(wait_time > max_waittime)
-				max_waittime = wait_time;
+			start(cur_IOreq, trackAt, simTime);
 		}
 		
 		//*Special case
-		if(cur_IOreq->track == trackAt) //The head does not need to move (input0 - SSTF)
+		if(cur_IOreq->end_time == simTime) //The head does not need to move (input0 - SSTF)
 			simTime--;
 	}
-	//Print summary
-	for(int i = 0; i < IO_list.size(); i++) {
+	printSummary();
+}
+
+//Everything the loop depends on between two ticks: the clock and head, the statistics, the requests as the front
+//end and the device left them, the queues of the front end and the policy and the position in the trace.
+//The requests themselves are read again from the same input file.
+template<class Policy>
+void Simulator::snapshot(Checkpoint &ck, Policy* IOsche, FrontEnd* front, int &simTime, int &trackAt, IOrequest* &cur_IOreq) {
+	char ck_alg = alg;
+	long num_requests = IO_list.size();
+	ck.io(ck_alg);
+	ck.io(num_requests);
+	if(ck_alg != alg)
+		ck.fail("written with another IO scheduler");
+	if(num_requests != (long)IO_list.size())
+		ck.fail("written with another input file");
+	Index<IOrequest> reqs;
+	reqs.id_of = [](IOrequest* r) { return (long)r->index; };
+	reqs.at = [&](long id) { return IO_list[id]; };
+	ck.io(simTime);
+	ck.io(trackAt);
+	ck.ref(cur_IOreq, reqs);
+	ck.io(total_time);
+	ck.io(max_waittime);
+	ck.io(tot_movement);
+	ck.io(num_started);
+	ck.io(total_turnaround);
+	ck.io(total_waittime);
+	ck.io(rw_count);
+	ck.io(rw_wait);
+	ck.io(rw_max);
+	ck.io(IOsche->cur_time);
+	for(auto r : IO_list) {
+		ck.io(r->sector);
+		ck.io(r->size);
+		ck.io(r->start_time);
+		ck.io(r->end_time);
+		ck.refs(r->merged, reqs);
+	}
+	source->checkpoint(ck);
+	front->checkpoint(ck, reqs);
+	IOsche->checkpoint(ck, reqs);
+}
+
+void Simulator::printSummary() {
+	for(int i = 0; i < (int)IO_list.size(); i++) {
 		IOrequest* r = IO_list[i];
 		printf("%5d: %5d %5d %5d\n", i, r->arrival_time, r->start_time, r->end_time);
 	}
-	avg_turnaround = (double)total_turnaround / IO_list.size();
-	avg_waittime = (double)total_waittime / IO_list.size();
-	printf("SUM: %d %d %.2lf %.2lf %d\n", total_time, tot_movement, avg_turnaround, avg_waittime, max_waittime);
+	avg_turnaround = (double)total_turnaround / num_started;
+	avg_waittime = (double)total_waittime / num_started;
+	printf("SUM: %d %ld %.2lf %.2lf %d\n", total_time, tot_movement, avg_turnaround, avg_waittime, max_waittime);
+	//Wait times by direction when the input has writes
+	if(rw_count[1] > 0)
+		printf("RW: %ld %.2lf %d %ld %.2lf %d\n", rw_count[0], rw_count[0] ? (double)rw_wait[0] / rw_count[0] : 0.0, rw_max[0],
+				rw_count[1], (double)rw_wait[1] / rw_count[1], rw_max[1]);
+	if(merging || plug_ticks > 0) {
+		int back = 0, front = 0, unplugs = 0;
+		for(auto fe : fronts) {
+			back += fe->back_merges;
+			front += fe->front_merges;
+			unplugs += fe->unplugs;
+		}
+		printf("MERGE: %d %d %d\n", back, front, unplugs);
+	}
+	if(tenants) {
+		//Share of the sectors dispatched while every tenant had requests outstanding against the share by the weights,
+		//and completion latency percentiles per tenant. Over the whole run every tenant gets what it asked for.
+		map<int, vector<int>> latency;
+		map<int, long> sectors;
+		map<int, int> weight;
+		long tot_sectors = 0, tot_weight = 0;
+		vector<pair<pair<int, int>, IOrequest*>> timeline; //by time, then completions, arrivals and dispatches
+		for(auto r : IO_list) {
+			latency[r->tenant].push_back(r->end_time - r->arrival_time);
+			weight[r->tenant] = r->weight;
+			timeline.push_back(make_pair(make_pair(r->end_time, 0), r));
+			timeline.push_back(make_pair(make_pair(r->arrival_time, 1), r));
+			timeline.push_back(make_pair(make_pair(r->start_time, 2), r));
+		}
+		sort(timeline.begin(), timeline.end(), [](const pair<pair<int, int>, IOrequest*> &a, const pair<pair<int, int>, IOrequest*> &b) {
+			return a.first < b.first;
+		});
+		map<int, int> outstanding;
+		int backlogged = 0;
+		for(auto &event : timeline) {
+			IOrequest* r = event.second;
+			if(event.first.second == 0 && --outstanding[r->tenant] == 0)
+				backlogged--;
+			else if(event.first.second == 1 && outstanding[r->tenant]++ == 0)
+				backlogged++;
+			else if(event.first.second == 2 && backlogged == (int)weight.size()) {
+				int own = r->size; //A merged request has grown by the sectors it absorbed
+				for(auto m : r->merged)
+					own -= m->size;
+				sectors[r->tenant] += own;
+				tot_sectors += own;
+			}
+		}
+		for(auto &w : weight)
+			tot_weight += w.second;
+		for(auto &l : latency) {
+			vector<int> &lat = l.second;
+			sort(lat.begin(), lat.end());
+			printf("TENANT[%d]: W=%d N=%lu SH=%.2lf FAIR=%.2lf P50=%d P95=%d P99=%d\n", l.first, weight[l.first], lat.size(),
+					tot_sectors ? 100.0 * sectors[l.first] / tot_sectors : 0.0, 100.0 * weight[l.first] / tot_weight,
+					lat[lat.size() / 2], lat[lat.size() * 95 / 100], lat[lat.size() * 99 / 100]);
+		}
+	}
+}
+
+//Multi-queue block layer (blk-mq)
+//Every submitter CPU has a software queue ordered by the chosen policy, software queue i feeds hardware queue i % hw.
+//A hardware queue holds at most depth requests (tags) between dispatch and completion, the device serves as many
+//requests at once as it has channels and takes them from the hardware queues round robin.
+//Every software queue has its own policy instance, the first is passed in and make builds the others.
+template<class Policy, class Make>
+void Simulator::run_mq(Policy* first, Make make, int num_sw, int num_hw, int depth) {
+	vector<Policy*> sw_queues;
+	for(int i = 0; i < num_sw; i++) {
+		sw_queues.push_back(i == 0 ? first : make());
+		fronts.push_back(new FrontEnd(sw_queues[i], merging, plug_ticks));
+	}
+	vector<deque<IOrequest*>> hw_queues(num_hw);
+	vector<int> tags(num_hw, 0), next_sw(num_hw, 0);
+	vector<IOrequest*> channels(disk->channels(), NULL);
+	
+	int simTime = 0, trackAt = 0, next_hw = 0, max_depth = 0;
+	long admitted = 0, completed = 0;
+	long long tag_ticks = 0;
+	IOrequest* newIO;
+	while(!source->done() || completed < admitted) {
+		simTime++;
+		//1) Every IO arriving at this time goes to the software queue of its submitter
+		while((newIO = source->peek()) != NULL && newIO->arrival_time <= simTime) {
+			fronts[newIO->cpu % num_sw]->submit(newIO, simTime);
+			source->pop();
+			admitted++;
+		}
+		for(auto front : fronts)
+			front->unplug(simTime);
+		bool progress = true;
+		while(progress) { //Zero length services complete within the tick
+			progress = false;
+			//2) Completions free their tags
+			for(auto &ch : channels) {
+				if(ch != NULL && ch->end_time <= simTime) {
+					total_time = simTime;
+					tags[ch->cpu % num_sw % num_hw]--;
+					completed += 1 + ch->merged.size();
+					source->completed(ch, simTime);
+					ch = NULL;
+					progress = true;
+				}
+			}
+			//3) Dispatch: each hardware queue with free tags takes up to MQ_BATCH requests from each of its software queues in turn
+			for(int hw = 0; hw < num_hw; hw++) {
+				int idle = 0, mapped = (num_sw - hw + num_hw - 1) / num_hw;
+				while(tags[hw] < depth && mapped > 0 && idle < mapped) {
+					Policy* sw = sw_queues[hw + next_sw[hw] * num_hw];
+					FrontEnd* front = fronts[hw + next_sw[hw] * num_hw];
+					next_sw[hw] = (next_sw[hw] + 1) % mapped;
+					sw->cur_time = simTime;
+					int batch = 0;
+					IOrequest* IOreq;
+					while(batch < MQ_BATCH && tags[hw] < depth && (IOreq = sw->getIOrequest(trackAt)) != NULL) {
+						front->dispatched(IOreq);
+						hw_queues[hw].push_back(IOreq);
+						tags[hw]++;
+						batch++;
+					}
+					idle = batch ? 0 : idle + 1;
+				}
+			}
+			//4) Idle device channels start the oldest request of the next non-empty hardware queue
+			for(auto &ch : channels) {
+				for(int i = 0; ch == NULL && i < num_hw; i++) {
+					deque<IOrequest*> &hwq = hw_queues[next_hw];
+					next_hw = (next_hw + 1) % num_hw;
+					if(hwq.empty())
+						continue;
+					ch = hwq.front();
+					hwq.pop_front();
+					start(ch, trackAt, simTime);
+					trackAt = ch->track;
+					progress = true;
+				}
+			}
+		}
+		int in_use = 0;
+		for(int hw = 0; hw < num_hw; hw++)
+			in_use += tags[hw];
+		tag_ticks += in_use;
+		if(in_use > max_depth)
+			max_depth = in_use;
+	}
+	printSummary();
+	//Average and peak number of tags in use, completions per 1000 ticks
+	printf("MQ: %d %d %d %.2lf %d %.2lf\n", num_sw, num_hw, depth, simTime ? (double)tag_ticks / simTime : 0.0, max_depth,
+			total_time ? 1000.0 * num_started / total_time : 0.0);
 }
 
 int main(int argc, char* argv[]) {
-	string scheAlg;
-	int c;
-	while((c = getopt(argc, argv, "s:")) != -1) {
-		scheAlg = optarg;
-	} 
-	string infile = argv[optind];
+	string scheAlg, diskModel = "l";
+	int c, num_sw = 0, num_hw = 1, depth = 1;
 	Simulator sim;
-	sim.scheduling(infile, scheAlg);
+	while((c = getopt(argc, argv, "s:m:q:Mp:G:c:R:")) != -1) {
+		if(c == 's')
+			scheAlg = optarg;
+		if(c == 'm') //[-m<model>] disk service time model
+			diskModel = optarg;
+		if(c == 'q') //[-q<sw>:<hw>:<depth>] multi-queue block layer
+			sscanf(optarg, "%d:%d:%d", &num_sw, &num_hw, &depth);
+		if(c == 'M') //[-M] merge adjacent requests
+			sim.merging = true;
+		if(c == 'p') //[-p<ticks>] plug submissions
+			sim.plug_ticks = atoi(optarg);
+		if(c == 'G') //[-G<workload>] generate the requests, see workload.h
+			sim.workload_spec = optarg;
+		if(c == 'c') { //[-c<ticks>:<file>] checkpoint every so many ticks
+			char path[4096];
+			if(sscanf(optarg, "%d:%4095s", &sim.checkpoint_every, path) == 2)
+				sim.checkpoint_file = path;
+			else
+				sim.checkpoint_every = 0;
+		}
+		if(c == 'R') //[-R<file>] resume from a checkpoint of a run on the same input file
+			sim.restore_file = optarg;
+	} 
+	string infile = optind < argc ? argv[optind] : "";
+	if(num_sw > 0)
+		sim.scheduling_mq(infile, scheAlg, diskModel, num_sw, max(num_hw, 1), max(depth, 1));
+	else
+		sim.scheduling(infile, scheAlg, diskModel);
 }
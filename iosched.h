@@ -0,0 +1,807 @@
+#ifndef IOSCHED_H
+#define IOSCHED_H
+
+#include <cstdlib>
+#include <vector>
+#include <list>
+#include <map>
+#include <unordered_map>
+#include <climits>
+#include <cmath>
+#include "checkpoint.h"
+using namespace std;
+
+//IO requests and the disk scheduling policies, shared by the IO scheduler and the swap device of the VMM
+namespace iosched {
+
+struct IOrequest{
+	public:
+		int arrival_time;
+		int start_time;
+		int end_time;
+		int index;
+		int track;
+		int sector; //first sector on the track
+		int size; //number of sectors transferred
+		bool write;
+		int tenant, weight; //submitting tenant and its share of the disk
+		int cpu; //submitting CPU, picks the software queue of the multi-queue mode
+		vector<IOrequest*> merged; //requests absorbed into this one, they complete with it
+		IOrequest(int id, int timeStep, int trackNum, int sectorNum = 0, int numSectors = 1);
+};
+
+IOrequest::IOrequest(int id, int timeStep, int trackNum, int sectorNum, int numSectors) {
+	index = id;
+	arrival_time = timeStep;
+	track = trackNum;
+	sector = sectorNum;
+	size = numSectors;
+	write = false;
+	tenant = 0;
+	weight = 1;
+	cpu = id;
+	start_time = 0;
+	end_time = 0;
+}
+
+//Disk service time models
+//Times are in simulation ticks. The rotational models assume a platter that spins from sector 0 at time 0.
+#define SECTORS_PER_TRACK 32
+#define SECTOR_TIME 1 //ticks for one sector to pass under the head, one revolution takes SECTORS_PER_TRACK * SECTOR_TIME
+#define SEEK_SETTLE 2 //head settle time of any non-zero seek
+#define SEEK_SHORT 2 //short seeks accelerate and decelerate, SEEK_SETTLE + SEEK_SHORT * sqrt(distance)
+#define SEEK_KNEE 64 //longer seeks coast at full speed
+#define SEEK_LONG 8 //tracks passed per tick while coasting
+#define SSD_ACCESS 3 //flash read latency, independent of the address
+#define SSD_CHANNELS 8 //flash channels serving requests in parallel
+
+class DiskModel {
+	public:
+		DiskModel();
+		//Ticks from the end of the previous request at cur_track until req is transferred, starting at time now
+		virtual int service_time(int cur_track, IOrequest* req, int now);
+		virtual int seek_time(int distance);
+		virtual int rotation_time(IOrequest* req, int now) { return 0; }
+		virtual int transfer_time(IOrequest* req) { return 0; }
+		//Requests the device serves at the same time
+		virtual int channels() { return 1; }
+};
+
+DiskModel::DiskModel() {
+	
+}
+
+int DiskModel::service_time(int cur_track, IOrequest* req, int now) {
+	int seek = seek_time(abs(req->track - cur_track));
+	return seek + rotation_time(req, now + seek) + transfer_time(req);
+}
+
+//One tick per track, no settle, rotation or transfer (the classic lab model)
+int DiskModel::seek_time(int distance) {
+	return distance;
+}
+
+//Seek curve and transfer, rotational latency ignored
+class SeekCurve : public DiskModel {
+	public:
+		SeekCurve();
+		int seek_time(int distance);
+		int transfer_time(IOrequest* req);
+};
+
+SeekCurve::SeekCurve() {
+	
+}
+
+int SeekCurve::seek_time(int distance) {
+	if(distance == 0)
+		return 0;
+	if(distance <= SEEK_KNEE)
+		return (int)(SEEK_SETTLE + SEEK_SHORT * sqrt((double)distance) + 0.5);
+	return SEEK_SETTLE + SEEK_SHORT * (int)sqrt((double)SEEK_KNEE) + (distance - SEEK_KNEE + SEEK_LONG - 1) / SEEK_LONG;
+}
+
+int SeekCurve::transfer_time(IOrequest* req) {
+	return req->size * SECTOR_TIME;
+}
+
+//Seek curve, wait for the first sector to come around, transfer
+class Rotational : public SeekCurve {
+	public:
+		Rotational();
+		int rotation_time(IOrequest* req, int now);
+};
+
+Rotational::Rotational() {
+	
+}
+
+int Rotational::rotation_time(IOrequest* req, int now) {
+	int under_head = (now / SECTOR_TIME) % SECTORS_PER_TRACK;
+	int sectors = (req->sector - under_head + SECTORS_PER_TRACK) % SECTORS_PER_TRACK;
+	return sectors * SECTOR_TIME;
+}
+
+//Flash: fixed access latency and transfer, no positioning at all
+class SSD : public DiskModel {
+	public:
+		SSD();
+		int seek_time(int distance);
+		int transfer_time(IOrequest* req);
+		int channels() { return SSD_CHANNELS; }
+};
+
+SSD::SSD() {
+	
+}
+
+int SSD::seek_time(int distance) {
+	return SSD_ACCESS;
+}
+
+int SSD::transfer_time(IOrequest* req) {
+	return req->size * SECTOR_TIME;
+}
+
+//Choose disk model: l=linear seek c=seek curve r=rotational s=SSD
+DiskModel* newDiskModel(char model) {
+	if(model == 'l')
+		return new DiskModel();
+	if(model == 'c')
+		return new SeekCurve();
+	if(model == 'r')
+		return new Rotational();
+	if(model == 's')
+		return new SSD();
+	return NULL;
+}
+ 
+class IOScheduler {
+	public:
+		int cur_time; //time of the dispatch, kept up to date by the caller for the time aware policies
+		IOScheduler();
+		virtual void addIOrequest(IOrequest* IOreq) {}
+		virtual	IOrequest* getIOrequest(int cur_track) { return NULL; }
+		//Saves or restores the queued requests and the policy state
+		virtual void checkpoint(Checkpoint &ck, Index<IOrequest> &reqs) {}
+		//True while requests are pending but held back on purpose, the caller has to come back later
+		virtual bool idling() { return false; }
+};
+
+IOScheduler::IOScheduler() {
+	cur_time = 0;
+}
+
+//First In First Out
+class FIFO final : public IOScheduler {
+	public:
+		FIFO();
+		void addIOrequest(IOrequest* IOreq);
+		IOrequest* getIOrequest(int cur_track);
+		void checkpoint(Checkpoint &ck, Index<IOrequest> &reqs);
+	private:
+		vector<IOrequest*> queue;
+}; 
+
+FIFO::FIFO() {
+	
+}
+
+void FIFO::addIOrequest(IOrequest* IOreq) {
+	queue.push_back(IOreq);
+}
+
+IOrequest* FIFO::getIOrequest(int cur_track) {
+	if(!queue.empty()) {
+		IOrequest* IOreq = queue.front();
+		queue.erase(queue.begin());
+		return IOreq;
+	} 
+	else
+		return NULL;
+} 
+
+void FIFO::checkpoint(Checkpoint &ck, Index<IOrequest> &reqs) {
+	ck.refs(queue, reqs);
+}
+
+//Shortest Seek Time First
+class SSTF final : public IOScheduler {
+	public:
+		SSTF();	
+		void addIOrequest(IOrequest* IOreq);
+		IOrequest* getIOrequest(int cur_track);
+		void checkpoint(Checkpoint &ck, Index<IOrequest> &reqs);
+	private:
+		vector<IOrequest*> queue;
+};
+
+SSTF::SSTF() {
+	
+}
+
+void SSTF::addIOrequest(IOrequest* IOreq) {
+	queue.push_back(IOreq);
+}
+
+IOrequest* SSTF::getIOrequest(int cur_track) {
+	if(!queue.empty()) {
+		IOrequest* sstio = NULL;
+		int min = INT_MAX, id = 0;
+		for(int i = 0; i < (int)queue.size(); i++) {
+			IOrequest* temp = queue[i];
+			if(abs(temp->track - cur_track) < min) {
+				min = abs(temp->track - cur_track);
+				sstio = temp;
+				id = i;
+			}
+		}
+		queue.erase(queue.begin() + id);
+		return sstio;
+	}
+	else
+		return NULL;
+}
+
+void SSTF::checkpoint(Checkpoint &ck, Index<IOrequest> &reqs) {
+	ck.refs(queue, reqs);
+}
+
+//No end looking SCAN
+class LOOK final : public IOScheduler {
+	public:
+		LOOK();
+		void addIOrequest(IOrequest* IOreq);
+		IOrequest* getIOrequest(int cur_track);
+		void checkpoint(Checkpoint &ck, Index<IOrequest> &reqs);
+	private:
+		int dir;
+		vector<IOrequest*> queue;
+};
+
+LOOK::LOOK() {
+	dir = 1; //The initial direction is from 0-tracks to higher tracks
+}
+
+void LOOK::addIOrequest(IOrequest* IOreq) {
+	queue.push_back(IOreq); 
+}
+
+IOrequest* LOOK::getIOrequest(int cur_track) {
+	if(!queue.empty()) {
+		IOrequest* lookio = NULL;
+		int min = INT_MAX, id = 0;
+		for(int i = 0; i < (int)queue.size(); i++) {
+			IOrequest* temp = queue[i];
+			if(dir == 1) {
+				int dis = temp->track - cur_track;
+				if(dis >= 0 && dis < min) { //dis >= 0 in case that two IOs have same track number
+					min = dis;
+					lookio = temp;
+					id = i;
+				}
+			}
+			if(dir == -1) {
+				int dis = cur_track - temp->track;
+				if(dis >= 0 && dis < min) {
+					min = dis;
+					lookio = temp;
+					id = i;
+				}
+			}
+		}
+		if(lookio == NULL) {
+			dir = -dir; //No proper outIO, reverse the direction
+			lookio = getIOrequest(cur_track);
+		}
+		else { //Don't want to erase innocent IOs
+			queue.erase(queue.begin() + id);
+		}
+		return lookio;
+	} 
+	else
+		return NULL;
+}
+
+void LOOK::checkpoint(Checkpoint &ck, Index<IOrequest> &reqs) {
+	ck.io(dir);
+	ck.refs(queue, reqs);
+}
+
+//No end looking C-SCAN
+class CLOOK final : public IOScheduler {
+	public:
+		CLOOK();
+		void addIOrequest(IOrequest* IOreq);
+		IOrequest* getIOrequest(int cur_track);
+		void checkpoint(Checkpoint &ck, Index<IOrequest> &reqs);
+	private:
+		vector<IOrequest*> queue;
+};
+
+CLOOK::CLOOK() {
+	
+}
+
+void CLOOK::addIOrequest(IOrequest* IOreq) {
+	queue.push_back(IOreq);
+}
+
+IOrequest* CLOOK::getIOrequest(int cur_track) {
+	if(!queue.empty()) {
+		IOrequest* clookio = NULL;
+		int min = INT_MAX, id = 0;
+		//From lower to higher, find the min IO
+		for(int i = 0; i < (int)queue.size(); i++) {
+			IOrequest* temp = queue[i];
+			int dis = temp->track - cur_track;
+			if(dis >= 0 && dis < min) {
+				min = dis;
+				clookio = temp;
+				id = i;
+			}
+		}
+		if(clookio == NULL) { //Returns back to the beginning
+			cur_track = 0;
+			clookio = getIOrequest(cur_track);
+		}
+		else
+			queue.erase(queue.begin() + id);
+		return clookio;
+	}
+	else {
+		return NULL;	
+	}
+}
+
+void CLOOK::checkpoint(Checkpoint &ck, Index<IOrequest> &reqs) {
+	ck.refs(queue, reqs);
+}
+
+//LOOK with two queues
+class FLOOK final : public IOScheduler {
+	public:
+		FLOOK();
+		void addIOrequest(IOrequest* IOreq);
+		IOrequest* getIOrequest(int cur_track);		
+		void checkpoint(Checkpoint &ck, Index<IOrequest> &reqs);
+	private:
+		//Use two queues add to one, retrieve from the other, when empty flip the pointers
+		int dir;
+		vector<IOrequest*> proc_queue;
+		vector<IOrequest*> wait_queue;
+};
+
+FLOOK::FLOOK() {
+	dir = 1;
+}
+
+void FLOOK::addIOrequest(IOrequest* IOreq) {
+	wait_queue.push_back(IOreq);
+}
+
+IOrequest* FLOOK::getIOrequest(int cur_track) {
+	if(proc_queue.empty()) {
+		proc_queue = wait_queue;
+		wait_queue.clear();
+	}
+	//proc_queue is empty on first access, so switch the queues
+	if(!proc_queue.empty()) {
+		IOrequest* flookio = NULL;
+		int min = INT_MAX, id = 0;
+		//continue in the direction you were going from the current position
+		for(int i = 0; i < (int)proc_queue.size(); i++) {
+			IOrequest* temp = proc_queue[i];
+			if(dir == 1) {
+				int dis = temp->track - cur_track;
+				if(dis >= 0 && dis < min) {
+					min = dis;
+					flookio = temp;
+					id = i;
+				}
+			}
+			if(dir == -1) {
+				int dis = cur_track - temp->track;
+				if(dis >= 0 && dis < min) {
+					min = dis;
+					flookio = temp;
+					id = i;
+				}
+			}
+		}
+		//then switch direction until empty 
+		if(flookio == NULL && !proc_queue.empty()) {
+			dir = -dir;
+			flookio = getIOrequest(cur_track);
+		}
+		else {
+			proc_queue.erase(proc_queue.begin() + id);
+		}
+		return flookio;
+	}
+	else
+		return NULL;
+}
+
+void FLOOK::checkpoint(Checkpoint &ck, Index<IOrequest> &reqs) {
+	ck.io(dir);
+	ck.refs(proc_queue, reqs);
+	ck.refs(wait_queue, reqs);
+}
+
+//Shortest Access Time First
+//Minimizes seek plus rotational latency. Requests are indexed by track and only the SATF_WINDOW tracks nearest to the head
+//are costed, nearest first, stopping early once the seek alone exceeds the best access time found.
+#define SATF_WINDOW 16
+class SATF final : public IOScheduler {
+	public:
+		SATF(DiskModel* disk);
+		void addIOrequest(IOrequest* IOreq);
+		IOrequest* getIOrequest(int cur_track);
+		void checkpoint(Checkpoint &ck, Index<IOrequest> &reqs);
+	private:
+		DiskModel* disk;
+		multimap<int, IOrequest*> queue; //by track
+};
+
+SATF::SATF(DiskModel* disk) : disk(disk) {
+	
+}
+
+void SATF::addIOrequest(IOrequest* IOreq) {
+	queue.insert(make_pair(IOreq->track, IOreq));
+}
+
+IOrequest* SATF::getIOrequest(int cur_track) {
+	if(queue.empty())
+		return NULL;
+	multimap<int, IOrequest*>::iterator up = queue.lower_bound(cur_track), down = up, best = queue.end();
+	int min = INT_MAX, tracks = 0, last_up = -1, last_down = -1; //every request of a track in the window is costed
+	while(true) {
+		bool has_up = up != queue.end(), has_down = down != queue.begin();
+		if(!has_up && !has_down)
+			break;
+		multimap<int, IOrequest*>::iterator cand;
+		if(has_up && (!has_down || up->first - cur_track <= cur_track - prev(down)->first))
+			cand = up;
+		else
+			cand = prev(down);
+		int &last = cand == up ? last_up : last_down;
+		if(cand->first != last) {
+			if(tracks == SATF_WINDOW)
+				break;
+			tracks++;
+			last = cand->first;
+		}
+		if(cand == up)
+			up++;
+		else
+			down--;
+		int seek = disk->seek_time(abs(cand->first - cur_track));
+		if(seek > min) //Candidates only get farther from here on
+			break;
+		int access = seek + disk->rotation_time(cand->second, cur_time + seek);
+		if(access < min || (access == min && cand->second->index < best->second->index)) {
+			min = access;
+			best = cand;
+		}
+	}
+	IOrequest* satfio = best->second;
+	queue.erase(best);
+	return satfio;
+}
+
+void SATF::checkpoint(Checkpoint &ck, Index<IOrequest> &reqs) {
+	ck.keyed_refs(queue, reqs);
+}
+
+//Deadline
+//Reads and writes each sit in a track sorted queue and in a FIFO. Requests are dispatched in batches sweeping up the
+//sorted queue, a new batch starts at the oldest request when it has expired. Reads are preferred, but writes are
+//served after WRITES_STARVED read batches.
+#define READ_EXPIRE 500
+#define WRITE_EXPIRE 5000
+#define FIFO_BATCH 16
+#define WRITES_STARVED 2
+class Deadline final : public IOScheduler {
+	public:
+		Deadline();
+		void addIOrequest(IOrequest* IOreq);
+		IOrequest* getIOrequest(int cur_track);
+		void checkpoint(Checkpoint &ck, Index<IOrequest> &reqs);
+	private:
+		int dir, batching, starved; //current batch is dir (0 reads, 1 writes)
+		multimap<int, IOrequest*> sorted[2];
+		list<IOrequest*> fifo[2];
+		multimap<int, IOrequest*>::iterator next[2]; //continues the sweep, end() when it wrapped
+		unordered_map<IOrequest*, list<IOrequest*>::iterator> fifo_pos;
+		IOrequest* dispatch(multimap<int, IOrequest*>::iterator it);
+};
+
+Deadline::Deadline() {
+	dir = 0;
+	batching = 0;
+	starved = 0;
+	next[0] = sorted[0].end();
+	next[1] = sorted[1].end();
+}
+
+void Deadline::addIOrequest(IOrequest* IOreq) {
+	int rw = IOreq->write;
+	sorted[rw].insert(make_pair(IOreq->track, IOreq));
+	fifo[rw].push_back(IOreq);
+	fifo_pos[IOreq] = prev(fifo[rw].end());
+}
+
+IOrequest* Deadline::dispatch(multimap<int, IOrequest*>::iterator it) {
+	IOrequest* IOreq = it->second;
+	dir = IOreq->write;
+	next[dir] = std::next(it);
+	sorted[dir].erase(it);
+	auto pos = fifo_pos.find(IOreq);
+	fifo[dir].erase(pos->second);
+	fifo_pos.erase(pos);
+	batching++;
+	return IOreq;
+}
+
+IOrequest* Deadline::getIOrequest(int cur_track) {
+	//Keep sweeping within the batch
+	if(next[dir] != sorted[dir].end() && batching < FIFO_BATCH)
+		return dispatch(next[dir]);
+	bool reads = !sorted[0].empty(), writes = !sorted[1].empty();
+	if(!reads && !writes)
+		return NULL;
+	if(reads && !(writes && starved >= WRITES_STARVED)) {
+		if(writes)
+			starved++;
+		dir = 0;
+	}
+	else {
+		starved = 0;
+		dir = 1;
+	}
+	batching = 0;
+	IOrequest* oldest = fifo[dir].front();
+	int expire = dir ? WRITE_EXPIRE : READ_EXPIRE;
+	if(cur_time - oldest->arrival_time >= expire || next[dir] == sorted[dir].end()) { //Start over from the oldest request
+		auto range = sorted[dir].equal_range(oldest->track);
+		for(auto it = range.first; it != range.second; it++)
+			if(it->second == oldest)
+				return dispatch(it);
+	}
+	return dispatch(next[dir]);
+}
+
+void Deadline::checkpoint(Checkpoint &ck, Index<IOrequest> &reqs) {
+	ck.io(dir);
+	ck.io(batching);
+	ck.io(starved);
+	for(int rw = 0; rw < 2; rw++) {
+		ck.keyed_refs(sorted[rw], reqs);
+		ck.pos(sorted[rw], next[rw]);
+		ck.refs(fifo[rw], reqs);
+		if(!ck.saving)
+			for(auto it = fifo[rw].begin(); it != fifo[rw].end(); it++)
+				fifo_pos[*it] = it;
+	}
+}
+
+//Budget Fair Queueing
+//Every tenant has its own track sorted queue and is served for a slot of at most its budget or BFQ_TIMEOUT ticks,
+//sweeping up from the head within the slot. Slots are ordered by virtual finish time (WF2Q+): a tenant's finish time
+//advances by the sectors it was served divided by its weight, a slot cut by the timeout is charged the full budget.
+//Budgets follow use: a tenant that runs dry gets the sectors it was served as its next budget, one that used up its
+//budget twice as much, up to BFQ_BUDGET, so a tenant issuing one request at a time is not queued behind a full budget.
+//When the queue of a sequential tenant runs dry the disk idles up to BFQ_IDLE ticks for its next request, as long as
+//its requests used to follow each other that closely.
+#define BFQ_BUDGET 64
+#define BFQ_TIMEOUT 200
+#define BFQ_IDLE 8
+#define BFQ_SEEKY 8 //mean distance in tracks between requests above which a tenant is not worth idling for
+class BFQ final : public IOScheduler {
+	public:
+		BFQ();
+		void addIOrequest(IOrequest* IOreq);
+		IOrequest* getIOrequest(int cur_track);
+		void checkpoint(Checkpoint &ck, Index<IOrequest> &reqs);
+		bool idling();
+	private:
+		struct Tenant {
+			int weight, budget, served, slot_start, last_track, requests, emptied_at;
+			double start, finish, seek_mean, think_mean; //think time from the dispatch that emptied its queue
+			multimap<int, IOrequest*> queue;
+		};
+		map<int, Tenant> tenants; //ordered, ties in select() go to the lowest id
+		Tenant* active;
+		double vtime;
+		int idle_until, pending;
+		void expire(bool timed_out);
+		Tenant* select();
+};
+
+BFQ::BFQ() {
+	active = NULL;
+	vtime = 0;
+	idle_until = -1;
+	pending = 0;
+}
+
+void BFQ::addIOrequest(IOrequest* IOreq) {
+	auto found = tenants.find(IOreq->tenant);
+	if(found == tenants.end()) {
+		Tenant tenant{};
+		tenant.budget = BFQ_BUDGET;
+		tenant.served = 0;
+		tenant.slot_start = 0;
+		tenant.requests = 0;
+		tenant.last_track = IOreq->track;
+		tenant.start = vtime;
+		tenant.finish = vtime;
+		tenant.seek_mean = 0;
+		found = tenants.insert(make_pair(IOreq->tenant, tenant)).first;
+	}
+	Tenant &tenant = found->second;
+	tenant.weight = max(IOreq->weight, 1);
+	if(tenant.requests++ > 0)
+		tenant.seek_mean = 0.7 * tenant.seek_mean + 0.3 * abs(IOreq->track - tenant.last_track);
+	tenant.last_track = IOreq->track;
+	if(tenant.queue.empty() && tenant.requests > 1)
+		tenant.think_mean = 0.7 * tenant.think_mean + 0.3 * max(IOreq->arrival_time - tenant.emptied_at, 0);
+	if(tenant.queue.empty() && &tenant != active) { //Backlogged again
+		tenant.start = max(vtime, tenant.finish);
+		tenant.finish = tenant.start + (double)tenant.budget / tenant.weight;
+	}
+	tenant.queue.insert(make_pair(IOreq->track, IOreq));
+	pending++;
+}
+
+void BFQ::expire(bool timed_out) {
+	active->finish = active->start + (double)(timed_out ? active->budget : active->served) / active->weight;
+	if(active->served >= active->budget)
+		active->budget = min(2 * active->budget, BFQ_BUDGET);
+	else if(!timed_out)
+		active->budget = max(active->served, 1);
+	if(!active->queue.empty()) {
+		active->start = active->finish;
+		active->finish = active->start + (double)active->budget / active->weight;
+	}
+	active = NULL;
+	idle_until = -1;
+}
+
+//Smallest finish time among the tenants whose start time has been reached
+BFQ::Tenant* BFQ::select() {
+	Tenant* next = NULL;
+	double min_start = -1;
+	for(auto &entry : tenants) {
+		Tenant &tenant = entry.second;
+		if(!tenant.queue.empty() && (min_start < 0 || tenant.start < min_start))
+			min_start = tenant.start;
+	}
+	if(min_start < 0)
+		return NULL;
+	vtime = max(vtime, min_start);
+	for(auto &entry : tenants) {
+		Tenant &tenant = entry.second;
+		if(!tenant.queue.empty() && tenant.start <= vtime && (next == NULL || tenant.finish < next->finish))
+			next = &tenant;
+	}
+	return next;
+}
+
+IOrequest* BFQ::getIOrequest(int cur_track) {
+	if(active != NULL) {
+		if(active->queue.empty()) {
+			if(idle_until < 0 && active->seek_mean <= BFQ_SEEKY && active->think_mean <= BFQ_IDLE &&
+					cur_time - active->slot_start < BFQ_TIMEOUT)
+				idle_until = cur_time + BFQ_IDLE; //Anticipate the next request of a sequential stream
+			if(idle_until > cur_time)
+				return NULL;
+			expire(false);
+		}
+		else if(active->served >= active->budget || cur_time - active->slot_start >= BFQ_TIMEOUT)
+			expire(active->served < active->budget);
+	}
+	if(active == NULL) {
+		active = select();
+		if(active == NULL)
+			return NULL;
+		active->served = 0;
+		active->slot_start = cur_time;
+	}
+	auto it = active->queue.lower_bound(cur_track);
+	if(it == active->queue.end())
+		it = active->queue.begin();
+	IOrequest* bfqio = it->second;
+	active->queue.erase(it);
+	active->served += bfqio->size;
+	if(active->queue.empty())
+		active->emptied_at = cur_time;
+	idle_until = -1;
+	pending--;
+	return bfqio;
+}
+
+bool BFQ::idling() {
+	return pending > 0 && idle_until > cur_time;
+}
+
+void BFQ::checkpoint(Checkpoint &ck, Index<IOrequest> &reqs) {
+	ck.io(vtime);
+	ck.io(idle_until);
+	ck.io(pending);
+	long num_tenants = tenants.size();
+	ck.io(num_tenants);
+	auto it = tenants.begin();
+	for(long i = 0; i < num_tenants; i++) {
+		int id = ck.saving ? it->first : 0;
+		ck.io(id);
+		Tenant &tenant = ck.saving ? (it++)->second : tenants[id];
+		ck.io(tenant.weight);
+		ck.io(tenant.budget);
+		ck.io(tenant.served);
+		ck.io(tenant.slot_start);
+		ck.io(tenant.last_track);
+		ck.io(tenant.requests);
+		ck.io(tenant.start);
+		ck.io(tenant.finish);
+		ck.io(tenant.seek_mean);
+		ck.io(tenant.emptied_at);
+		ck.io(tenant.think_mean);
+		ck.keyed_refs(tenant.queue, reqs);
+	}
+	bool has_active = active != NULL;
+	int active_id = 0;
+	for(auto &entry : tenants)
+		if(&entry.second == active)
+			active_id = entry.first;
+	ck.io(has_active);
+	ck.io(active_id);
+	active = has_active ? &tenants[active_id] : NULL;
+}
+
+//Choose IO scheduler: i=FIFO j=SSTF s=LOOK c=CLOOK f=FLOOK a=SATF d=Deadline b=BFQ
+//SATF costs requests with the given disk model, the linear seek model if none
+//Calls run with a new scheduler of the chosen policy typed as that policy, so a loop written as a template
+//is instantiated per policy and its calls into the policy bind statically. False if no policy has the letter.
+template<class Run>
+bool dispatchIOScheduler(char alg, DiskModel* disk, Run run) {
+	switch(alg) {
+		case 'i':
+			run(new FIFO());
+			return true;
+		case 'j':
+			run(new SSTF());
+			return true;
+		case 's':
+			run(new LOOK());
+			return true;
+		case 'c':
+			run(new CLOOK());
+			return true;
+		case 'f':
+			run(new FLOOK());
+			return true;
+		case 'a':
+			run(new SATF(disk != NULL ? disk : new DiskModel()));
+			return true;
+		case 'd':
+			run(new Deadline());
+			return true;
+		case 'b':
+			run(new BFQ());
+			return true;
+	}
+	return false;
+}
+
+IOScheduler* newIOScheduler(char alg, DiskModel* disk = NULL) {
+	IOScheduler* IOsche = NULL;
+	dispatchIOScheduler(alg, disk, [&](IOScheduler* chosen) { IOsche = chosen; });
+	return IOsche;
+}
+
+}
+
+#endif
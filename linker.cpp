@@ -140,10 +140,11 @@ string Parser::getToken() {
 		linenum = cur_line;
 		lineoffset = cur_offset;
 	}	
+	return token;
 }
 
 bool Parser::isInt(string token) {
-	for(int i = 0; i < token.length(); i++)
+	for(int i = 0; i < (int)token.length(); i++)
 		if(!isdigit(token[i]))
 			return false;
 	return true;
@@ -152,7 +153,7 @@ bool Parser::isInt(string token) {
 bool Parser::isSym(string token) {
 	if(!isalpha(token[0]))
 		return false;
-	for(int i = 1; i < token.length(); i++)
+	for(int i = 1; i < (int)token.length(); i++)
 		if(!isalnum(token[i]))
 			return false;
 	return true;
@@ -205,7 +206,7 @@ void Parser::passOne() {
 			Symbol symbol(modnum, sym, val);
 			int flag = 0;
 			int index  = -1;
-			for(int j = 0; j < def_list.size(); j++) { //not find
+			for(int j = 0; j < (int)def_list.size(); j++) { //not find
 				Symbol &s = def_list[j];
 				if(s.sym.compare(sym) == 0) {
 					index = j;
@@ -245,7 +246,7 @@ void Parser::passOne() {
 	}
 	
 	//Check rule 5
-	for(int i = 0; i < def_list.size(); i++) {
+	for(int i = 0; i < (int)def_list.size(); i++) {
 		Symbol &symbol = def_list[i];
 		Module &module = mod_list[symbol.modnum - 1];
 		if(symbol.rel_addr > module.size - 1) {
@@ -269,8 +270,8 @@ void Parser::passTwo() {
 		//Read def list
 		int defcount = readInt();
 		for(int i = 0; i < defcount; i++) {
-			string sym = readSym();
-			int val = readInt(); 
+			readSym();
+			readInt();
 		}
 		
 		//Read use list
@@ -316,7 +317,7 @@ void Parser::passTwo() {
 						instr = 9999;
 						printf("%03d: %04d Error: Illegal opcode; treated as 9999", lcount, instr);
 					}
-					else if(oprand > module.use_list.size() - 1) {
+					else if(oprand > (int)module.use_list.size() - 1) {
 						printf("%03d: %04d Error: External address exceeds length of uselist; treated as immediate", lcount, instr);
 					}
 					else {
@@ -324,7 +325,7 @@ void Parser::passTwo() {
 						module.use_list[oprand].second = true;
 						int flag = 0;
 						int index = -1;
-						for(int j = 0; j < def_list.size(); j++) { //not find
+						for(int j = 0; j < (int)def_list.size(); j++) { //not find
 							Symbol &s = def_list[j];
 							if(s.sym.compare(sym) == 0) {
 								flag = 1;
@@ -366,19 +367,9 @@ void Parser::passTwo() {
 		modnum++;
 		
 		//Check rule 7
-		for(int i = 0; i < module.use_list.size(); i++) {
+		for(int i = 0; i < (int)module.use_list.size(); i++) {
 			string sym = module.use_list[i].first;
 			bool used = module.use_list[i].second;
-			int flag = 0;
-			int index = -1;
-			for(int j = 0; j < def_list.size(); j++) { //not find
-				Symbol &s = def_list[j];
-				if(s.sym.compare(sym) == 0) {
-					index = j;
-					flag = 1;
-					break;
-				}
-			}
 			if(used == false) {
 				printf("Warning: Module %d: %s appeared in the uselist but was not actually used\n", modnum, sym.c_str());
 			}
@@ -386,7 +377,7 @@ void Parser::passTwo() {
 	}
 	cout<<endl;
 	//Check rule 4
-	for(int i = 0; i < def_list.size(); i++) {
+	for(int i = 0; i < (int)def_list.size(); i++) {
 		Symbol &symbol = def_list[i];
 		if(symbol.used == 0)
 			printf("Warning: Module %d: %s was defined but never used\n", symbol.modnum, symbol.sym.c_str());
@@ -410,7 +401,7 @@ void Parser::parseError(int errcode) {
 
 void Parser::printSymTab() {
 	cout<<"Symbol Table"<<endl;
-	for(int i = 0; i < def_list.size(); i++) {
+	for(int i = 0; i < (int)def_list.size(); i++) {
 		Symbol &symbol = def_list[i];
 		cout<<symbol.sym<<"="<<symbol.abs_addr;
 		if(symbol.defined != 1) //rule 2
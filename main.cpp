@@ -7,6 +7,10 @@
 #include <unistd.h>
 #include <bitset>
 #include <climits> 
+#include <list>
+#include <unordered_map>
+#include <algorithm>
+#include "iosched.h"
 using namespace std;
 
 #define MAP 400
@@ -20,6 +24,15 @@ using namespace std;
 #define SEGPROT 300
 #define READ_WRITE 1
 #define CONTEXT_SWITCH 121
+#define DISK_SEEK 5 //per track the swap disk head moves
+#define DISK_XFER 2000 //transfer of one page
+#define PAGE_XFER 500 //read-ahead page transferred after the seek of the faulting page, or after the first page of its run
+#define FORK 1000
+#define COW_COPY 200 //copy of a page on the first write after fork
+#define HUGE_PAGES 8 //base pages (and frames) covered by one huge page, aligned
+#define HUGE_ZERO 600 //clearing a whole huge frame at once
+#define HUGE_COPY 1600 //khugepaged copies the base pages into the new huge frame
+#define HUGE_SPLIT 300 //demote a huge mapping to base page mappings
 
 struct PTE { 
 	unsigned int PRESENT : 1;
@@ -29,7 +42,9 @@ struct PTE {
 	unsigned int PAGEDOUT : 1;
 	unsigned int FRAMEINDEX : 7;
 	unsigned int FILEMAPPED : 1;
-	unsigned int OWNUSAGE : 19;
+	unsigned int COW : 1; //shared with a forked process until the next write
+	unsigned int HUGE : 1; //part of a huge page mapping
+	unsigned int OWNUSAGE : 17;
 	
 	PTE();	
 };
@@ -42,6 +57,8 @@ PTE::PTE() {
 	PAGEDOUT = 0;
 	FRAMEINDEX = 0;
 	FILEMAPPED = 0;
+	COW = 0;
+	HUGE = 0;
 }
 
 class VMA {
@@ -50,27 +67,77 @@ class VMA {
 		unsigned int ending_virtual_page : 7;
 		unsigned int write_protected : 1;
 		unsigned int filemapped : 1;
+		unsigned int huge : 1; //aligned runs of anonymous private pages may be mapped by huge pages
+		int shmid; //shared memory segment mapped by this VMA, -1 if private
 		
-		VMA(int start_page, int end_page, int write_prot, int file_map);
+		VMA(int start_page, int end_page, int write_prot, int file_map, int shm_id, int huge_page);
 }; 
 
-VMA::VMA(int start_page, int end_page, int write_prot, int file_map) {
+VMA::VMA(int start_page, int end_page, int write_prot, int file_map, int shm_id, int huge_page) {
 	starting_virtual_page = start_page;
 	ending_virtual_page = end_page;
 	write_protected = write_prot;
 	filemapped = file_map;
+	shmid = shm_id;
+	huge = huge_page && !file_map && shm_id == -1;
 }
 
 //Keep track of the inverse mapping: (frame --> <proc-id,vpage>) inside each frame's frame table entry
+//A frame shared after fork or through a shared VMA has one entry per mapping, <pid,vpage> is the first of them
+//A huge page is held by the first frame of an aligned run, the rest of the run (tails) are invisible to the pagers
 class Frame {
 	public:
 		int pid, vpage, index;
+		int refcount;
+		long shmkey; //shared page held by this frame, -1 if private
+		bool free;
+		bool huge; //maps HUGE_PAGES pages starting at vpage
+		Frame* head; //huge frame this frame is a tail of, NULL otherwise
+		vector<pair<int, int>> rmap;
 		Frame(int i);
+		void map(int proc, int page);
+		void unmap(int proc, int page);
 };
 
 Frame::Frame(int i) {
 	index = i;
 	pid = -1; //initialization
+	vpage = -1;
+	refcount = 0;
+	shmkey = -1;
+	free = true;
+	huge = false;
+	head = NULL;
+}
+
+void Frame::map(int proc, int page) {
+	rmap.push_back(make_pair(proc, page));
+	refcount++;
+	pid = rmap.front().first;
+	vpage = rmap.front().second;
+}
+
+void Frame::unmap(int proc, int page) {
+	rmap.erase(find(rmap.begin(), rmap.end(), make_pair(proc, page)));
+	refcount--;
+	if(refcount > 0) {
+		pid = rmap.front().first;
+		vpage = rmap.front().second;
+	}
+	else
+		pid = -1;
+}
+
+//Page of a shared memory segment, found through <shmid, offset> by every process mapping the segment
+struct SharedPage {
+	Frame* frame; //NULL while not resident
+	bool pagedout;
+	SharedPage();
+};
+
+SharedPage::SharedPage() {
+	frame = NULL;
+	pagedout = false;
 }
 
 //A global frame_table describe the usage of each of its physical frames 
@@ -78,29 +145,79 @@ Frame::Frame(int i) {
 class FrameTable {
 	public:
 		vector<Frame> inverse_map;
+		vector<Frame*> free_list; //back is handed out first
+		bool reclaiming; //get_frame() reports no free frame while kswapd collects victims
+		vector<Frame*>* scope; //frames of the memory group whose pager runs, NULL for all of them
 		FrameTable();
 		FrameTable(int num_frame);
 		Frame* get_frame();
+		Frame* get_huge_frame();
+		void put_frame(Frame* frame);
+		template<class Visit>
+		void scan(Visit visit);
 };
 
 FrameTable::FrameTable() {
-	
+	scope = NULL;
 }
 
 FrameTable::FrameTable(int num_frame) {
+	reclaiming = false;
+	scope = NULL;
 	for(int i = 0; i < num_frame; i++)
 		inverse_map.push_back(Frame(i));
+	for(int i = num_frame - 1; i >= 0; i--) //lowest frame first
+		free_list.push_back(&inverse_map[i]);
 }
 
 Frame* FrameTable::get_frame() {
-	for(int i = 0; i < inverse_map.size(); i++) {
-		Frame* frame = &(inverse_map[i]);
-		if(frame->pid == -1) //first available
-			return frame;
+	if(free_list.empty() || reclaiming)
+		return NULL;
+	Frame* frame = free_list.back();
+	free_list.pop_back();
+	frame->free = false;
+	return frame;
+}
+
+//First aligned run of HUGE_PAGES free frames, NULL if memory is too fragmented
+Frame* FrameTable::get_huge_frame() {
+	if(reclaiming)
+		return NULL;
+	for(int i = 0; i + HUGE_PAGES <= (int)inverse_map.size(); i += HUGE_PAGES) {
+		int run = 0;
+		while(run < HUGE_PAGES && inverse_map[i + run].free)
+			run++;
+		if(run < HUGE_PAGES)
+			continue;
+		for(int j = i; j < i + HUGE_PAGES; j++)
+			inverse_map[j].free = false;
+		free_list.erase(remove_if(free_list.begin(), free_list.end(), [](Frame* frame) { return !frame->free; }), free_list.end());
+		return &inverse_map[i];
 	}
 	return NULL;
 }
 
+void FrameTable::put_frame(Frame* frame) {
+	frame->free = true;
+	frame->pid = -1;
+	frame->rmap.clear();
+	frame->refcount = 0;
+	free_list.push_back(frame);
+}
+
+//Visits the frames a pager that scans may choose from, in order
+template<class Visit>
+void FrameTable::scan(Visit visit) {
+	if(scope != NULL) {
+		for(auto frame : *scope)
+			visit(frame);
+	}
+	else {
+		for(auto &frame : inverse_map)
+			visit(&frame);
+	}
+}
+
 //Compute and print the summary statistics related to the VMM
 //Track the number of instructions, segv, segprot, unmap, map, pageins (IN, FIN), pageouts (OUT, FOUT), and zero operations for each process
 struct Pstats {
@@ -114,6 +231,16 @@ struct Pstats {
 	unsigned long zeros;
 	unsigned long segv;
 	unsigned long segprot;
+	unsigned long readaheads;
+	unsigned long cowbreaks; //private copies made on write after fork
+	unsigned long sharedhits; //faults served by a frame another process already holds
+	//Huge page mappings are counted apart from the base page ones above
+	unsigned long hugefaults;
+	unsigned long hugemaps;
+	unsigned long hugeunmaps;
+	unsigned long promotions; //collapsed by khugepaged
+	unsigned long demotions; //split into base pages
+	unsigned long hugefallbacks; //eligible faults served by a base page for lack of an aligned free run
 
 	Pstats();
 };
@@ -128,6 +255,15 @@ Pstats::Pstats() {
 	zeros = 0;
 	segv = 0;
 	segprot = 0;
+	readaheads = 0;
+	cowbreaks = 0;
+	sharedhits = 0;
+	hugefaults = 0;
+	hugemaps = 0;
+	hugeunmaps = 0;
+	promotions = 0;
+	demotions = 0;
+	hugefallbacks = 0;
 }	
 
 //Create process with its list of vmas and a page_table that 
@@ -145,24 +281,66 @@ Process::Process(int index) {
 	pid = index;
 }
 
+//A frame counts as referenced (modified) if any of the pages mapping it is, a huge frame if any page of its run is
+bool frame_referenced(Frame* frame, vector<Process*>& proc_list) {
+	int span = frame->huge ? HUGE_PAGES : 1;
+	for(auto &owner : frame->rmap)
+		for(int i = 0; i < span; i++)
+			if(proc_list[owner.first]->pageTable[owner.second + i].REFERENCED)
+				return true;
+	return false;
+}
+
+bool frame_modified(Frame* frame, vector<Process*>& proc_list) {
+	int span = frame->huge ? HUGE_PAGES : 1;
+	for(auto &owner : frame->rmap)
+		for(int i = 0; i < span; i++)
+			if(proc_list[owner.first]->pageTable[owner.second + i].MODIFIED)
+				return true;
+	return false;
+}
+
+void clear_referenced(Frame* frame, vector<Process*>& proc_list) {
+	int span = frame->huge ? HUGE_PAGES : 1;
+	for(auto &owner : frame->rmap)
+		for(int i = 0; i < span; i++)
+			proc_list[owner.first]->pageTable[owner.second + i].REFERENCED = 0;
+}
+
 //Pager class
 class Pager {
 	public:
 		Pager();
 		virtual Frame* select_frame(vector<Process*>& proc_list, FrameTable* frame_table) {
-			
+			return NULL;
 		}
+		//Called after the faulting instruction has been served from the newly mapped frame
+		virtual void mapped_frame(Frame* frame, vector<Process*>& proc_list) {}
+		//Called when a victim is put back on the free list instead of being reused right away
+		virtual void free_frame(Frame* frame) {}
+		//Called for frames the VMM took from the free list itself (huge frames, tails of a split huge frame)
+		virtual void adopt_frame(Frame* frame) {}
+		//Called when the first owner of a mapped frame changed, key is the page the frame was known by until now
+		virtual void rekey_frame(Frame* frame, unsigned long key) {}
+		//Saves or restores the replacement state
+		virtual void checkpoint(Checkpoint &ck, Index<Frame> &frames) {}
 };
 
 Pager::Pager() {
 	
 }
 
+//Hash key of a virtual page, used by the pagers that remember pages after eviction
+unsigned long page_key(int pid, int vpage) {
+	return ((unsigned long)pid << 6) | vpage;
+}
+
 //Get random number for Random and NRU
 class getRand {
 	public:
 		getRand(const string &rfile);
 		int getRandomNumber(int size);
+		void checkpoint(Checkpoint &ck);
 	private:
 		int rcount, rofs;
 		vector<int> randomValue;
@@ -186,11 +364,23 @@ int getRand::getRandomNumber(int size) {
 	return rind;
 }
 
+//The numbers are read again from the same rfile, only the cursor is kept
+void getRand::checkpoint(Checkpoint &ck) {
+	int ck_rcount = rcount;
+	ck.io(ck_rcount);
+	if(ck_rcount != rcount)
+		ck.fail("written with another random file");
+	ck.io(rofs);
+}
+
 //First In First Out
-class FIFO : public Pager {
+class FIFO final : public Pager {
 	public:
 		FIFO();
 		Frame* select_frame(vector<Process*>& proc_list, FrameTable* frame_table);
+		void free_frame(Frame* frame);
+		void adopt_frame(Frame* frame);
+		void checkpoint(Checkpoint &ck, Index<Frame> &frames);
 	private:
 		vector<Frame*> frame_queue; 
 		//Use vector O(1) compared to queue O(n)
@@ -212,11 +402,26 @@ Frame* FIFO::select_frame(vector<Process*>& proc_list, FrameTable* frame_table)
 	return frame; 
 }
 
+void FIFO::free_frame(Frame* frame) {
+	frame_queue.erase(find(frame_queue.begin(), frame_queue.end(), frame));
+}
+
+void FIFO::adopt_frame(Frame* frame) {
+	frame_queue.push_back(frame);
+}
+
+void FIFO::checkpoint(Checkpoint &ck, Index<Frame> &frames) {
+	ck.refs(frame_queue, frames);
+}
+
 //Second Chance
-class SC : public Pager {
+class SC final : public Pager {
 	public:
 		SC();
 		Frame* select_frame(vector<Process*>& proc_list, FrameTable* frame_table);
+		void free_frame(Frame* frame);
+		void adopt_frame(Frame* frame);
+		void checkpoint(Checkpoint &ck, Index<Frame> &frames);
 	private:
 		vector<Frame*> frame_queue;
 };
@@ -229,13 +434,11 @@ Frame* SC::select_frame(vector<Process*>& proc_list, FrameTable* frame_table) {
 	Frame* frame = frame_table->get_frame();
 	if(frame == NULL) {
 		frame = frame_queue.front();	
-		PTE* pte = &(proc_list[frame->pid]->pageTable[frame->vpage]);
-		while(pte->REFERENCED) {
-			pte->REFERENCED = 0; //Reset ref bit
+		while(frame_referenced(frame, proc_list)) {
+			clear_referenced(frame, proc_list); //Reset ref bit
 			frame_queue.erase(frame_queue.begin());
 			frame_queue.push_back(frame); //Push to the end
 			frame = frame_queue.front(); //Check the next frame
-			pte = &(proc_list[frame->pid]->pageTable[frame->vpage]); 
 		}
 		frame_queue.erase(frame_queue.begin());
 		frame_queue.push_back(frame); //Push back to the end of the queue
@@ -245,8 +448,20 @@ Frame* SC::select_frame(vector<Process*>& proc_list, FrameTable* frame_table) {
 	return frame;
 }
 
+void SC::free_frame(Frame* frame) {
+	frame_queue.erase(find(frame_queue.begin(), frame_queue.end(), frame));
+}
+
+void SC::adopt_frame(Frame* frame) {
+	frame_queue.push_back(frame);
+}
+
+void SC::checkpoint(Checkpoint &ck, Index<Frame> &frames) {
+	ck.refs(frame_queue, frames);
+}
+
 //Random
-class Random : public Pager{
+class Random final : public Pager{
 	public:
 		Random(getRand* randNum);
 		Frame* select_frame(vector<Process*>& proc_list, FrameTable* frame_table);
@@ -260,19 +475,28 @@ Random::Random(getRand* randNum) : randNum(randNum){
 
 Frame* Random::select_frame(vector<Process*>& proc_list, FrameTable* frame_table) {
 	Frame* frame = frame_table->get_frame();
-	if(frame == NULL) {
+	if(frame == NULL && frame_table->scope != NULL) { //Within a memory group, every frame of it is mapped
+		vector<Frame*> &scope = *frame_table->scope;
+		frame = scope[randNum->getRandomNumber(scope.size())];
+	}
+	else if(frame == NULL) {
 		int size = frame_table->inverse_map.size();
 		int index = randNum->getRandomNumber(size);
 		frame = &(frame_table->inverse_map[index]);
+		while(frame->pid == -1) { //Only while kswapd reclaims with frames already free
+			index = randNum->getRandomNumber(size);
+			frame = &(frame_table->inverse_map[index]);
+		}
 	}
 	return frame;
 }
 
 //Not Recently Used
-class NRU : public Pager{
+class NRU final : public Pager{
 	public:
 		NRU(getRand* randNum);
 		Frame* select_frame(vector<Process*>& proc_list, FrameTable* frame_table);
+		void checkpoint(Checkpoint &ck, Index<Frame> &frames);
 	private:
 		int clock;
 		vector<Frame*> classes[4]; //Two dimensinal vector for each class and each frame
@@ -291,15 +515,12 @@ Frame* NRU::select_frame(vector<Process*>& proc_list, FrameTable* frame_table) {
 			cls.clear();
 		
 		//Classify the frames into their four classes
-		for(auto &tag : frame_table->inverse_map) {
-			int pid = tag.pid;
-			int vpage = tag.vpage;
-			if(pid != -1) { //Used frame 
-				PTE &pte = proc_list[pid]->pageTable[vpage];
-				int prior = pte.REFERENCED * 2 + pte.MODIFIED; //(0, 0) < (0, 1) < (1, 0) < (1, 1)
-				classes[prior].push_back(&tag);
+		frame_table->scan([&](Frame* tag) {
+			if(tag->pid != -1) { //Used frame 
+				int prior = frame_referenced(tag, proc_list) * 2 + frame_modified(tag, proc_list); //(0, 0) < (0, 1) < (1, 0) < (1, 1)
+				classes[prior].push_back(tag);
 			}
-		}
+		});
 		
 		//Identify the lowest class and randomly select a page from it
 		for(int i = 0; i < 4; i++) {
@@ -314,21 +535,26 @@ Frame* NRU::select_frame(vector<Process*>& proc_list, FrameTable* frame_table) {
 		if(clock == 10) {
 			clock = 0; //Every 10th page replacement request
 			for(int i = 0; i < 4; i++) {
-				for(auto tag : classes[i]) {
-					PTE &pte = proc_list[tag->pid]->pageTable[tag->vpage];
-					pte.REFERENCED = 0;
-				}
+				for(auto tag : classes[i])
+					clear_referenced(tag, proc_list);
 			} 
 		} 
 	}
 	return frame;
 }
 
+void NRU::checkpoint(Checkpoint &ck, Index<Frame> &frames) {
+	ck.io(clock);
+}
+
 //Clock
-class Clock : public Pager{
+class Clock final : public Pager{
 	public:
 		Clock();
 		Frame* select_frame(vector<Process*>& proc_list, FrameTable* frame_table);
+		void free_frame(Frame* frame);
+		void adopt_frame(Frame* frame);
+		void checkpoint(Checkpoint &ck, Index<Frame> &frames);
 	private:
 		int hand;
 		vector<Frame*> circle;
@@ -343,12 +569,10 @@ Frame* Clock::select_frame(vector<Process*>& proc_list, FrameTable* frame_table)
 	if(frame == NULL) {
 		//hand points to the frame number to be considered next
 		frame = circle[hand];
-		PTE* pte = &(proc_list[frame->pid]->pageTable[frame->vpage]);
-		while(pte->REFERENCED) { //Same as second chance
-			pte->REFERENCED = 0;
+		while(frame_referenced(frame, proc_list)) { //Same as second chance
+			clear_referenced(frame, proc_list);
 			hand = (hand + 1) % circle.size();
 			frame = circle[hand];
-			pte = &(proc_list[frame->pid]->pageTable[frame->vpage]);
 		}
 		hand = (hand + 1) % circle.size(); //Point to next frame
 	}
@@ -357,11 +581,31 @@ Frame* Clock::select_frame(vector<Process*>& proc_list, FrameTable* frame_table)
 	return frame;
 }
 
+void Clock::free_frame(Frame* frame) {
+	int pos = find(circle.begin(), circle.end(), frame) - circle.begin();
+	circle.erase(circle.begin() + pos);
+	if(pos < hand)
+		hand--;
+	if(hand >= (int)circle.size())
+		hand = 0;
+}
+
+void Clock::adopt_frame(Frame* frame) {
+	circle.push_back(frame);
+}
+
+void Clock::checkpoint(Checkpoint &ck, Index<Frame> &frames) {
+	ck.io(hand);
+	ck.refs(circle, frames);
+}
+
 //Aging
-class Aging : public Pager{
+class Aging final : public Pager{
 	public:
 		Aging(int size);
 		Frame* select_frame(vector<Process*>& proc_list, FrameTable* frame_table);
+		void free_frame(Frame* frame);
+		void checkpoint(Checkpoint &ck, Index<Frame> &frames);
 	private:
 		vector<unsigned int> age; //32 bits
 };
@@ -375,64 +619,848 @@ Frame* Aging::select_frame(vector<Process*>& proc_list, FrameTable* frame_table)
 	Frame* frame = frame_table->get_frame();
 	if(frame == NULL) {
 		unsigned long min = ULONG_MAX;
-		for(int i = 0; i < frame_table->inverse_map.size(); i++) {
-			Frame &tag = frame_table->inverse_map[i];
-			if(tag.pid != -1) { //Same as NRU
-				PTE &pte = proc_list[tag.pid]->pageTable[tag.vpage];
-				unsigned int ref = pte.REFERENCED;
-				age[i] = ((ref << 31) | (age[i] >> 1)); //Shift 1 bit to the right and set ref bit at the front
-				pte.REFERENCED = 0; //Reset
+		frame_table->scan([&](Frame* tag) {
+			if(tag->pid != -1) { //Same as NRU
+				unsigned int ref = frame_referenced(tag, proc_list);
+				age[tag->index] = ((ref << 31) | (age[tag->index] >> 1)); //Shift 1 bit to the right and set ref bit at the front
+				clear_referenced(tag, proc_list); //Reset
 			}
-		}
+		});
 
 		//Choose the page whose counter is lowest
-		for(int i = 0; i < frame_table->inverse_map.size(); i++) {
-			Frame &newframe = frame_table->inverse_map[i];
-			if(newframe.pid != -1) { //Present
-				if(age[i] < min) {
-					min = age[i];
-					frame = &newframe;
+		frame_table->scan([&](Frame* newframe) {
+			if(newframe->pid != -1) { //Present
+				if(age[newframe->index] < min) {
+					min = age[newframe->index];
+					frame = newframe;
 				}
 			}
-		}
+		});
 		age[frame->index] = 0; //Reset the counter of victim page
 	}
 	return frame;
 }
 
+void Aging::free_frame(Frame* frame) {
+	age[frame->index] = 0;
+}
+
+void Aging::checkpoint(Checkpoint &ck, Index<Frame> &frames) {
+	ck.io(age);
+}
+
+//Adaptive Replacement Cache (clock-based variant, CAR)
+//T1 holds pages seen once, T2 pages referenced again while resident.
+//B1/B2 remember the <pid,vpage> of pages recently evicted from T1/T2 and steer the target size p of T1.
+class ARC final : public Pager {
+	public:
+		ARC(int size);
+		Frame* select_frame(vector<Process*>& proc_list, FrameTable* frame_table);
+		void mapped_frame(Frame* frame, vector<Process*>& proc_list);
+		void free_frame(Frame* frame);
+		void checkpoint(Checkpoint &ck, Index<Frame> &frames);
+	private:
+		int c, p; //cache size and target size of T1
+		list<Frame*> t1, t2; //front is under the clock hand, back is just behind it
+		list<unsigned long> b1, b2; //ghost lists, front is MRU
+		unordered_map<unsigned long, list<unsigned long>::iterator> ghost1, ghost2; //O(1) lookup into the ghost lists
+};
+
+ARC::ARC(int size) {
+	c = size;
+	p = 0;
+}
+
+Frame* ARC::select_frame(vector<Process*>& proc_list, FrameTable* frame_table) {
+	Frame* frame = frame_table->get_frame();
+	while(frame == NULL) {
+		if(!t1.empty() && ((int)t1.size() >= max(1, p) || t2.empty())) {
+			Frame* head = t1.front();
+			t1.pop_front();
+			if(frame_referenced(head, proc_list)) { //Referenced again, move to the frequency side
+				clear_referenced(head, proc_list);
+				t2.push_back(head);
+			}
+			else {
+				b1.push_front(page_key(head->pid, head->vpage));
+				ghost1[b1.front()] = b1.begin();
+				frame = head;
+			}
+		}
+		else {
+			Frame* head = t2.front();
+			t2.pop_front();
+			if(frame_referenced(head, proc_list)) {
+				clear_referenced(head, proc_list);
+				t2.push_back(head);
+			}
+			else {
+				b2.push_front(page_key(head->pid, head->vpage));
+				ghost2[b2.front()] = b2.begin();
+				frame = head;
+			}
+		}
+	}
+	return frame;
+}
+
+void ARC::mapped_frame(Frame* frame, vector<Process*>& proc_list) {
+	unsigned long key = page_key(frame->pid, frame->vpage);
+	//The faulting access itself does not count as a re-reference
+	clear_referenced(frame, proc_list);
+	auto hit1 = ghost1.find(key);
+	auto hit2 = ghost2.find(key);
+	if(hit1 != ghost1.end()) { //Evicted from T1 too early, grow T1
+		p = min(p + max(1, (int)(b2.size() / b1.size())), c);
+		b1.erase(hit1->second);
+		ghost1.erase(hit1);
+		t2.push_back(frame);
+	}
+	else if(hit2 != ghost2.end()) { //Evicted from T2 too early, shrink T1
+		p = max(p - max(1, (int)(b1.size() / b2.size())), 0);
+		b2.erase(hit2->second);
+		ghost2.erase(hit2);
+		t2.push_back(frame);
+	}
+	else {
+		//Keep the directory bounded by 2c
+		if((int)(t1.size() + b1.size()) >= c && !b1.empty()) {
+			ghost1.erase(b1.back());
+			b1.pop_back();
+		}
+		else if((int)(t1.size() + t2.size() + b1.size() + b2.size()) >= 2 * c && !b2.empty()) {
+			ghost2.erase(b2.back());
+			b2.pop_back();
+		}
+		t1.push_back(frame);
+	}
+}
+
+//Victims have already left T1/T2, only frames released while still mapped are found here
+void ARC::free_frame(Frame* frame) {
+	t1.remove(frame);
+	t2.remove(frame);
+}
+
+void ARC::checkpoint(Checkpoint &ck, Index<Frame> &frames) {
+	ck.io(c);
+	ck.io(p);
+	ck.refs(t1, frames);
+	ck.refs(t2, frames);
+	for(int b = 0; b < 2; b++) {
+		list<unsigned long> &ghost_list = b ? b2 : b1;
+		unordered_map<unsigned long, list<unsigned long>::iterator> &ghost = b ? ghost2 : ghost1;
+		vector<unsigned long> keys(ghost_list.begin(), ghost_list.end());
+		ck.io(keys);
+		if(!ck.saving) {
+			ghost_list.assign(keys.begin(), keys.end());
+			ghost.clear();
+			for(auto it = ghost_list.begin(); it != ghost_list.end(); it++)
+				ghost[*it] = it;
+		}
+	}
+}
+
+//CLOCK-Pro
+//One clock holds hot and cold resident pages plus non-resident cold pages still in their test period.
+//A test page that faults again is brought back hot and enlarges the cold target.
+class ClockPro final : public Pager {
+	public:
+		ClockPro(int size);
+		Frame* select_frame(vector<Process*>& proc_list, FrameTable* frame_table);
+		void mapped_frame(Frame* frame, vector<Process*>& proc_list);
+		void free_frame(Frame* frame);
+		void rekey_frame(Frame* frame, unsigned long key);
+		void checkpoint(Checkpoint &ck, Index<Frame> &frames);
+	private:
+		typedef enum { PAGE_HOT, PAGE_COLD, PAGE_TEST } page_t;
+		struct Page {
+			unsigned long key;
+			page_t type;
+			Frame* frame; //NULL for test pages
+		};
+		int size, cold_target, count_hot, count_cold, count_test;
+		Frame* victim;
+		list<Page> ring;
+		unordered_map<unsigned long, list<Page>::iterator> index;
+		list<Page>::iterator hand_hot, hand_cold, hand_test;
+
+		void next(list<Page>::iterator &hand);
+		void prev(list<Page>::iterator &hand);
+		void remove(list<Page>::iterator page);
+		void run_hand_cold(vector<Process*>& proc_list);
+		void run_hand_hot(vector<Process*>& proc_list);
+		void run_hand_test();
+};
+
+ClockPro::ClockPro(int size) : size(size) {
+	cold_target = size;
+	count_hot = 0;
+	count_cold = 0;
+	count_test = 0;
+	victim = NULL;
+}
+
+void ClockPro::next(list<Page>::iterator &hand) {
+	hand++;
+	if(hand == ring.end())
+		hand = ring.begin();
+}
+
+void ClockPro::prev(list<Page>::iterator &hand) {
+	if(hand == ring.begin())
+		hand = ring.end();
+	hand--;
+}
+
+void ClockPro::remove(list<Page>::iterator page) {
+	//Hands standing on the removed page fall back so that their next step lands on its successor
+	if(hand_hot == page) prev(hand_hot);
+	if(hand_cold == page) prev(hand_cold);
+	if(hand_test == page) prev(hand_test);
+	auto entry = index.find(page->key);
+	if(entry != index.end() && entry->second == page)
+		index.erase(entry);
+	ring.erase(page);
+}
+
+void ClockPro::run_hand_cold(vector<Process*>& proc_list) {
+	Page &page = *hand_cold;
+	if(page.type == PAGE_COLD) {
+		if(frame_referenced(page.frame, proc_list)) { //Re-referenced within its test period
+			clear_referenced(page.frame, proc_list);
+			page.type = PAGE_HOT;
+			count_cold--;
+			count_hot++;
+		}
+		else { //Evict, but remember it as a test page
+			victim = page.frame;
+			page.type = PAGE_TEST;
+			page.frame = NULL;
+			count_cold--;
+			count_test++;
+			while(count_test > size)
+				run_hand_test();
+		}
+	}
+	next(hand_cold);
+	while(size - cold_target < count_hot)
+		run_hand_hot(proc_list);
+}
+
+void ClockPro::run_hand_hot(vector<Process*>& proc_list) {
+	if(hand_hot == hand_test)
+		run_hand_test();
+	Page &page = *hand_hot;
+	if(page.type == PAGE_HOT) {
+		if(frame_referenced(page.frame, proc_list))
+			clear_referenced(page.frame, proc_list);
+		else { //Demote
+			page.type = PAGE_COLD;
+			count_hot--;
+			count_cold++;
+		}
+	}
+	next(hand_hot);
+}
+
+void ClockPro::run_hand_test() {
+	//The test hand never overtakes the cold hand; push it along instead of evicting from here
+	if(hand_test == hand_cold)
+		next(hand_cold);
+	if(hand_test->type == PAGE_TEST) { //Test period over, forget the page
+		list<Page>::iterator page = hand_test;
+		remove(page);
+		count_test--;
+		if(cold_target > 1)
+			cold_target--;
+	}
+	next(hand_test);
+}
+
+Frame* ClockPro::select_frame(vector<Process*>& proc_list, FrameTable* frame_table) {
+	Frame* frame = frame_table->get_frame();
+	if(frame == NULL) {
+		victim = NULL;
+		while(victim == NULL) {
+			if(count_cold == 0) //Only while kswapd reclaims below the hot target
+				run_hand_hot(proc_list);
+			else
+				run_hand_cold(proc_list);
+		}
+		frame = victim;
+	}
+	return frame;
+}
+
+void ClockPro::mapped_frame(Frame* frame, vector<Process*>& proc_list) {
+	unsigned long key = page_key(frame->pid, frame->vpage);
+	Page page = {key, PAGE_COLD, frame};
+	clear_referenced(frame, proc_list);
+	auto test = index.find(key);
+	if(test != index.end() && test->second->type == PAGE_TEST) { //Faulted again during its test period
+		if(cold_target < size)
+			cold_target++;
+		remove(test->second);
+		count_test--;
+		page.type = PAGE_HOT;
+		count_hot++;
+	}
+	else
+		count_cold++;
+	//New pages enter at the list head, just behind the hot hand
+	list<Page>::iterator it;
+	if(ring.empty()) {
+		it = ring.insert(ring.end(), page);
+		hand_hot = hand_cold = hand_test = it;
+	}
+	else {
+		it = ring.insert(hand_hot, page);
+		if(hand_cold == hand_hot)
+			hand_cold = it;
+	}
+	index[key] = it;
+}
+
+//A COW copy took the page the frame was indexed by, index it by its new first owner
+void ClockPro::rekey_frame(Frame* frame, unsigned long key) {
+	auto entry = index.find(key);
+	if(entry == index.end() || entry->second->frame != frame)
+		return;
+	list<Page>::iterator page = entry->second;
+	index.erase(entry);
+	page->key = page_key(frame->pid, frame->vpage);
+	auto test = index.find(page->key);
+	if(test != index.end() && test->second->type == PAGE_TEST) { //The page is resident again through this frame
+		remove(test->second);
+		count_test--;
+	}
+	index[page->key] = page;
+}
+
+//Victims are already test pages, only frames released while still mapped are found here
+void ClockPro::free_frame(Frame* frame) {
+	for(auto it = ring.begin(); it != ring.end(); it++) {
+		if(it->frame == frame) {
+			if(it->type == PAGE_HOT)
+				count_hot--;
+			else
+				count_cold--;
+			remove(it);
+			return;
+		}
+	}
+}
+
+void ClockPro::checkpoint(Checkpoint &ck, Index<Frame> &frames) {
+	ck.io(cold_target);
+	ck.io(count_hot);
+	ck.io(count_cold);
+	ck.io(count_test);
+	ck.ref(victim, frames);
+	long num_pages = ring.size();
+	ck.io(num_pages);
+	if(!ck.saving)
+		ring.assign(num_pages, Page());
+	for(auto &page : ring) {
+		ck.io(page.key);
+		ck.io(page.type);
+		ck.ref(page.frame, frames);
+	}
+	if(!ring.empty()) { //The hands are only set once the first page entered
+		ck.pos(ring, hand_hot);
+		ck.pos(ring, hand_cold);
+		ck.pos(ring, hand_test);
+	}
+	//The index as positions in the ring, a key may have been indexed again after its frame changed owner
+	long num_keys = index.size();
+	ck.io(num_keys);
+	auto entry = index.begin();
+	if(!ck.saving)
+		index.clear();
+	for(long i = 0; i < num_keys; i++) {
+		unsigned long key = ck.saving ? entry->first : 0;
+		list<Page>::iterator it = ck.saving ? (entry++)->second : ring.end();
+		ck.io(key);
+		ck.pos(ring, it);
+		if(!ck.saving)
+			index[key] = it;
+	}
+}
+
+//Asynchronous swap device
+//Page-ins block the faulting instruction until the disk has served them, page-outs are queued and written back in the background.
+//The order in which queued IOs are served is decided by one of the IO scheduling policies.
+struct SwapIO : public iosched::IOrequest {
+	unsigned long key;
+	bool done;
+	long long submit, start, end;
+	int span; //tracks the head sweeps past the first one, size is the number of pages transferred
+	SwapIO(int id, int track, unsigned long key, bool write, long long now);
+};
+
+SwapIO::SwapIO(int id, int track, unsigned long key, bool write, long long now) : iosched::IOrequest(id, 0, track) {
+	this->key = key;
+	this->write = write;
+	done = false;
+	submit = now;
+	start = 0;
+	end = 0;
+	span = 0;
+}
+
+class SwapDisk {
+	public:
+		unsigned long reads, writes, cache_hits, tot_movement;
+		long long tot_latency, max_latency;
+		SwapDisk(iosched::IOScheduler* IOsche);
+		long long read(unsigned long key, int track, long long now);
+		void add_run(unsigned long key, int track);
+		long long read_run(long long now);
+		void write(unsigned long key, int track, long long now);
+		void checkpoint(Checkpoint &ck);
+	private:
+		int id, head;
+		long long epoch; //cost at which the clock of the IO scheduler stands at 0
+		iosched::IOScheduler* IOsche;
+		SwapIO* active;
+		unordered_map<unsigned long, SwapIO*> writeback; //dirty pages not yet on disk
+		map<int, SwapIO*> inflight; //writes queued or being served by id, a page written twice has two
+		SwapIO* run; //read-ahead pages collected for one read, NULL between two faults
+		void advance(long long now);
+		void submit(SwapIO* io, long long now);
+		void start(SwapIO* io, long long now);
+		long long wait(SwapIO* io, long long now);
+		int clock(long long now);
+};
+
+SwapDisk::SwapDisk(iosched::IOScheduler* IOsche) : IOsche(IOsche) {
+	reads = 0;
+	writes = 0;
+	cache_hits = 0;
+	tot_movement = 0;
+	tot_latency = 0;
+	max_latency = 0;
+	id = 0;
+	head = 0;
+	epoch = 0;
+	active = NULL;
+	run = NULL;
+}
+
+//The IO schedulers keep int times, the cost clock of the VMM outgrows them on long traces. Their clock is rebased
+//whenever the disk runs idle, only a disk busy for longer than INT_MAX ticks without a break would be clamped.
+int SwapDisk::clock(long long now) {
+	return (int)min(now - epoch, (long long)INT_MAX);
+}
+
+void SwapDisk::start(SwapIO* io, long long now) {
+	int move = abs(head - io->track) + io->span;
+	io->start = now;
+	io->end = now + (long long)move * DISK_SEEK + DISK_XFER + (long long)(io->size - 1) * PAGE_XFER;
+	tot_movement += move;
+	head = io->track + io->span;
+	active = io;
+}
+
+//Serve queued IOs until the disk has caught up with the instruction stream
+void SwapDisk::advance(long long now) {
+	while(active != NULL && active->end <= now) {
+		SwapIO* io = active;
+		long long end = io->end;
+		active = NULL;
+		io->done = true;
+		if(io->write) {
+			auto it = writeback.find(io->key);
+			if(it != writeback.end() && it->second == io)
+				writeback.erase(it);
+			inflight.erase(io->index);
+			delete io;
+		} //Reads are released by the waiting fault
+		IOsche->cur_time = clock(end);
+		SwapIO* next = (SwapIO*)IOsche->getIOrequest(head);
+		while(next == NULL && IOsche->idling()) { //Nothing else arrives while the fault waits, let the idle window pass
+			IOsche->cur_time++;
+			next = (SwapIO*)IOsche->getIOrequest(head);
+		}
+		if(next != NULL)
+			start(next, max(next->submit, end));
+	}
+}
+
+void SwapDisk::submit(SwapIO* io, long long now) {
+	advance(now);
+	if(active == NULL) //Nothing queued, whole revolutions keep the rotational position for SATF
+		epoch = now - now % (SECTORS_PER_TRACK * SECTOR_TIME);
+	io->arrival_time = clock(now);
+	if(active == NULL)
+		start(io, now);
+	else
+		IOsche->addIOrequest(io);
+}
+
+//Returns the latency seen by the faulting instruction
+long long SwapDisk::read(unsigned long key, int track, long long now) {
+	if(writeback.count(key)) { //Still in memory waiting for writeback
+		reads++;
+		cache_hits++;
+		return 0;
+	}
+	return wait(new SwapIO(id++, track, key, false, now), now);
+}
+
+//Read-ahead pages join the run the fault reads in one go, pages still waiting for writeback are served from memory
+void SwapDisk::add_run(unsigned long key, int track) {
+	if(writeback.count(key)) {
+		reads++;
+		cache_hits++;
+		return;
+	}
+	if(run == NULL) {
+		run = new SwapIO(id++, track, key, false, 0);
+		return;
+	}
+	run->span = track - run->track;
+	run->size++;
+}
+
+//One read for the whole run: a seek to its first page, then the further pages stream in, counted as a single read
+long long SwapDisk::read_run(long long now) {
+	if(run == NULL)
+		return 0;
+	SwapIO* io = run;
+	run = NULL;
+	io->submit = now;
+	return wait(io, now);
+}
+
+//Submits a read and serves the disk until it has completed, returns the latency seen by the faulting instruction
+long long SwapDisk::wait(SwapIO* io, long long now) {
+	reads++;
+	submit(io, now);
+	while(!io->done)
+		advance(active->end);
+	long long latency = io->end - now;
+	tot_latency += latency;
+	if(latency > max_latency)
+		max_latency = latency;
+	delete io;
+	return latency;
+}
+
+void SwapDisk::write(unsigned long key, int track, long long now) {
+	writes++;
+	SwapIO* io = new SwapIO(id++, track, key, true, now);
+	writeback[key] = io;
+	inflight[io->index] = io;
+	submit(io, now);
+}
+
+//Between two instructions every read has completed, the IOs still alive are writes
+void SwapDisk::checkpoint(Checkpoint &ck) {
+	ck.io(reads);
+	ck.io(writes);
+	ck.io(cache_hits);
+	ck.io(tot_movement);
+	ck.io(tot_latency);
+	ck.io(max_latency);
+	ck.io(id);
+	ck.io(head);
+	ck.io(epoch);
+	long num_ios = inflight.size();
+	ck.io(num_ios);
+	auto entry = inflight.begin();
+	if(!ck.saving)
+		inflight.clear();
+	for(long i = 0; i < num_ios; i++) {
+		SwapIO* io = ck.saving ? (entry++)->second : new SwapIO(0, 0, 0, true, 0);
+		ck.io(io->index);
+		ck.io(io->arrival_time);
+		ck.io(io->track);
+		ck.io(io->key);
+		ck.io(io->done);
+		ck.io(io->submit);
+		ck.io(io->start);
+		ck.io(io->end);
+		if(!ck.saving)
+			inflight[io->index] = io;
+	}
+	Index<SwapIO> ios;
+	ios.id_of = [](SwapIO* io) { return (long)io->index; };
+	ios.at = [&](long id) { return inflight.at(id); };
+	ck.ref(active, ios);
+	ck.keyed_refs(writeback, ios);
+	Index<iosched::IOrequest> reqs;
+	reqs.id_of = [](iosched::IOrequest* r) { return (long)r->index; };
+	reqs.at = [&](long id) { return (iosched::IOrequest*)inflight.at(id); };
+	ck.io(IOsche->cur_time);
+	IOsche->checkpoint(ck, reqs);
+}
+
+//Memory groups, switched on with -M<file> or -L
+//The file gives "<name> <frames> <pid> [<pid> ...]" per line, a group of the listed processes that may hold at most
+//that many frames, 0 for no limit. Every process it does not list is a group of its own without limit, so -L alone is
+//per-process local replacement. A forked child joins the group of its parent, or gets a group of its own if the parent
+//has one of its own. A frame is charged to the group of the process it was faulted in for.
+//Global replacement keeps the pager of the whole frame table. Only a group with a limit runs a pager of its own as well,
+//on the frames charged to it, and replaces one of them when it is at its limit. With local replacement (-L) every group
+//runs its own pager and a fault that finds no free frame replaces a frame of its own group, or while the group holds
+//none yet, one of the group holding the most frames. The pagers keeping lists only ever see the frames of their group,
+//the pagers that scan are given them as the scope of the frame table. A frame changing pagers is freed from the ones
+//that did not choose it and adopted by the ones keeping it next.
+struct MemCG {
+	string name;
+	int limit; //frames, 0 for none
+	bool implicit; //the group of a single process not named in the file
+	Pager* pager; //NULL while the pager of the whole table serves the group alone
+	vector<Frame*> frames; //charged to the group
+	int peak;
+	unsigned long instructions, faults, reclaimed, limit_reclaims;
+	MemCG(string name, int limit, bool implicit);
+};
+
+MemCG::MemCG(string name, int limit, bool implicit) : name(name), limit(limit), implicit(implicit) {
+	pager = NULL;
+	peak = 0;
+	instructions = 0;
+	faults = 0;
+	reclaimed = 0;
+	limit_reclaims = 0;
+}
+
 //Virtual Memory Management
 class VMM {
 	public:
 		VMM();
 		//Instruction* get_next_instruction();
 		void readInputFile(string infile);
-		void paging(string input, getRand *rand, string pagealg, bool Oop, bool Pop, bool Fop, bool Sop, int num_frames);
+		void paging(string input, getRand *rand, string pagealg, string diskalg, bool Oop, bool Pop, bool Fop, bool Sop, int num_frames,
+				int readahead, int low_watermark, int high_watermark, int khugepaged_period);
 		void printPageTable();
 		void printFrameTable();
 		void printSummary();
+		string checkpoint_file, restore_file;
+		int checkpoint_every; //instructions between two checkpoints, 0 for none
+		string memcg_file; //memory groups, see MemCG
+		bool local_replacement;
 	private:		
 		int ctx_switches, inst_count;
 		long long cost; 
 		getRand* rand;
 		Pager* pager;
 		FrameTable* frameTable;
+		SwapDisk* swapDisk; //NULL when IO costs are charged synchronously
 		//vector<Instruction> insList;
 		vector<Process*> procList;
 		Pstats pstats;
+		int readahead; //pages brought in behind a faulting page
+		int low_watermark, high_watermark; //free frame watermarks of kswapd, 0 when disabled
+		unsigned long reclaim_batches, reclaimed;
+		int swap_track(int pid, int vpage, bool file);
+		unordered_map<long, SharedPage> shmPages;
+		bool sharing; //the trace forks or maps shared memory
+		bool hugepages; //some VMA may be mapped by huge pages
+		int khugepaged_period; //instructions between two promotion passes, 0 when disabled
+		long long huge_cost; //part of the cost spent on huge page mappings
+		void evict(Frame* frame, bool Oop);
+		bool map_shared(Process* proc, int vpage, VMA* vma, bool Oop);
+		Frame* fault_in(Process* proc, int vpage, VMA* vma, bool readahead, bool Oop);
+		void fork_process(Process* parent, bool Oop);
+		void cow_break(Process* proc, int vpage, bool Oop);
+		void page_in(Process* proc, int vpage, Frame* frame, bool readahead, bool Oop);
+		void read_ahead(Process* proc, int vpage, VMA* vma, bool Oop);
+		void reclaim(bool Oop);
+		Frame* fault_huge(Process* proc, int vpage, VMA* vma, bool Oop);
+		void map_huge(Process* proc, int base, Frame* frame, bool Oop);
+		void split_huge(Frame* frame, bool Oop);
+		void khugepaged(bool Oop);
+		void snapshot(Checkpoint &ck, string pagealg, string diskalg, long &offset, Process* &cur_proc);
+		char pagealg;
+		int num_frames;
+		Pager* new_pager(int size);
+		vector<MemCG> memcgs; //none without memory groups
+		vector<int> proc_memcg, frame_memcg, frame_pos; //group of each process, group and place in it of each frame
+		void load_memcgs();
+		int add_memcg(string name, int limit, bool implicit);
+		Frame* select_frame(Process* proc);
+		void mapped_frame(Frame* frame);
+		void rekey_frame(Frame* frame, unsigned long key);
+		void charge(Frame* frame, int memcg);
+		void uncharge(Frame* frame);
 };
 
 VMM::VMM() {
 	ctx_switches = 0;
 	inst_count = 0;
 	cost = 0;
+	swapDisk = NULL;
+	readahead = 0;
+	low_watermark = 0;
+	high_watermark = 0;
+	reclaim_batches = 0;
+	reclaimed = 0;
+	sharing = false;
+	hugepages = false;
+	khugepaged_period = 0;
+	huge_cost = 0;
+	checkpoint_every = 0;
+	local_replacement = false;
+	pager = NULL;
+}
+
+//Pager of the chosen algorithm for a memory of size frames
+Pager* VMM::new_pager(int size) {
+	switch(pagealg) {
+		case 'f':
+			return new FIFO();
+		case 's':
+			return new SC();
+		case 'r':
+			return new Random(rand);
+		case 'n':
+			return new NRU(rand);
+		case 'c':
+			return new Clock();
+		case 'a':
+			return new Aging(num_frames); //Indexed by frame
+		case 'A':
+			return new ARC(size);
+		case 'p':
+			return new ClockPro(size);
+	}
+	return NULL;
+}
+
+int VMM::add_memcg(string name, int limit, bool implicit) {
+	memcgs.push_back(MemCG(name, limit, implicit));
+	if(local_replacement || limit > 0)
+		memcgs.back().pager = new_pager(limit > 0 ? min(limit, num_frames) : num_frames);
+	return memcgs.size() - 1;
+}
+
+void VMM::load_memcgs() {
+	proc_memcg.assign(procList.size(), -1);
+	if(!memcg_file.empty()) {
+		ifstream input(memcg_file.c_str());
+		if(!input) {
+			fprintf(stderr, "cannot open memory group file %s\n", memcg_file.c_str());
+			exit(1);
+		}
+		string line, name;
+		while(getline(input, line)) {
+			stringstream split(line);
+			int limit = 0, pid;
+			if(!(split >> name) || name[0] == '#')
+				continue;
+			split >> limit;
+			int memcg = add_memcg(name, max(limit, 0), false);
+			while(split >> pid)
+				if(pid >= 0 && pid < (int)procList.size())
+					proc_memcg[pid] = memcg;
+		}
+	}
+	for(int pid = 0; pid < (int)procList.size(); pid++)
+		if(proc_memcg[pid] < 0)
+			proc_memcg[pid] = add_memcg(to_string(pid), 0, true);
+	frame_memcg.assign(num_frames, -1);
+	frame_pos.assign(num_frames, -1);
+}
+
+//Frame for a page of proc, free or replaced, charged to the group of proc
+Frame* VMM::select_frame(Process* proc) {
+	if(memcgs.empty())
+		return pager->select_frame(procList, frameTable);
+	int own = proc_memcg[proc->pid], from = own; //group whose pager chooses, -1 for the pager of the whole table
+	MemCG &cg = memcgs[own];
+	bool at_limit = cg.limit > 0 && (int)cg.frames.size() >= cg.limit;
+	bool replace = at_limit || frameTable->free_list.empty();
+	if(!at_limit && !local_replacement)
+		from = -1;
+	else if(replace && !at_limit && cg.frames.empty()) {
+		for(int g = 0; g < (int)memcgs.size(); g++)
+			if(memcgs[g].frames.size() > memcgs[from].frames.size())
+				from = g;
+	}
+	Pager* chooser = from < 0 ? pager : memcgs[from].pager;
+	if(from >= 0) {
+		frameTable->reclaiming = replace; //The pager must pick a victim even if frames are free
+		frameTable->scope = &memcgs[from].frames;
+	}
+	Frame* frame = chooser->select_frame(procList, frameTable);
+	frameTable->scope = NULL;
+	frameTable->reclaiming = false;
+	if(replace) {
+		int victim = frame_memcg[frame->index];
+		Pager* held = memcgs[victim].pager;
+		memcgs[victim].reclaimed++;
+		if(at_limit)
+			memcgs[victim].limit_reclaims++;
+		uncharge(frame);
+		if(pager != NULL && pager != chooser)
+			pager->free_frame(frame);
+		if(held != NULL && (held != chooser || victim != own))
+			held->free_frame(frame);
+	}
+	if(pager != NULL && pager != chooser)
+		pager->adopt_frame(frame);
+	if(cg.pager != NULL && cg.pager != chooser)
+		cg.pager->adopt_frame(frame);
+	charge(frame, own);
+	return frame;
+}
+
+//Tells the pagers keeping the frame that it has been mapped
+void VMM::mapped_frame(Frame* frame) {
+	if(pager != NULL)
+		pager->mapped_frame(frame, procList);
+	if(!memcgs.empty() && memcgs[frame_memcg[frame->index]].pager != NULL)
+		memcgs[frame_memcg[frame->index]].pager->mapped_frame(frame, procList);
+}
+
+//Tells the pagers keeping the frame that it is now known by another page
+void VMM::rekey_frame(Frame* frame, unsigned long key) {
+	if(pager != NULL)
+		pager->rekey_frame(frame, key);
+	if(!memcgs.empty() && memcgs[frame_memcg[frame->index]].pager != NULL)
+		memcgs[frame_memcg[frame->index]].pager->rekey_frame(frame, key);
+}
+
+void VMM::charge(Frame* frame, int memcg) {
+	MemCG &cg = memcgs[memcg];
+	frame_memcg[frame->index] = memcg;
+	frame_pos[frame->index] = cg.frames.size();
+	cg.frames.push_back(frame);
+	cg.peak = max(cg.peak, (int)cg.frames.size());
+}
+
+void VMM::uncharge(Frame* frame) {
+	vector<Frame*> &frames = memcgs[frame_memcg[frame->index]].frames;
+	int pos = frame_pos[frame->index];
+	frames[pos] = frames.back();
+	frame_pos[frames[pos]->index] = pos;
+	frames.pop_back();
+	frame_memcg[frame->index] = -1;
+}
+
+//The swap slot and the file block of a page sit next to each other on the disk
+int VMM::swap_track(int pid, int vpage, bool file) {
+	return (pid * 64 + vpage) * 2 + file;
 }
 
 void VMM::printFrameTable() {
 	//Show which frame is mapped at the end to which <pid:virtual page> or '*' if not currently mapped by any virtual page
 	cout << "FT: ";
-	for(auto tag : frameTable->inverse_map) {
-		if(tag.pid != -1)
-			cout<<tag.pid<<":"<<tag.vpage<<" ";
+	for(auto &tag : frameTable->inverse_map) {
+		if(tag.pid != -1) {
+			cout<<tag.pid<<":"<<tag.vpage;
+			if(tag.refcount > 1) //Number of further mappings
+				cout<<"+"<<tag.refcount - 1;
+			if(tag.huge)
+				cout<<"H";
+			cout<<" ";
+		}
+		else if(tag.head != NULL) //Tail of a huge frame
+			cout<<tag.head->pid<<":"<<tag.head->vpage + tag.index - tag.head->index<<" ";
 		else
 			cout<<"* ";
 	}
@@ -443,9 +1471,9 @@ void VMM::printPageTable() {
 	//Print the content of the pagetable pte entries: R (referenced), M (modified), S (swapped out)
 	//Pages that are not valid are represented by a '#' if they have been swapped out, or a '*' if it does not have a swap area associated with. 
 	//Otherwise (valid) indicates the virtual page index and RMS bits with - indicated that that bit is not set.
-	for(int pid = 0; pid < procList.size(); pid++) {
+	for(int pid = 0; pid < (int)procList.size(); pid++) {
 		cout<<"PT["<<pid<<"]: ";
-		for(int i = 0; i < procList[pid]->pageTable.size(); i++) {
+		for(int i = 0; i < (int)procList[pid]->pageTable.size(); i++) {
 			PTE &pte = procList[pid]->pageTable[i];
 			if(!pte.PRESENT) { 
 				if(pte.PAGEDOUT)
@@ -475,23 +1503,437 @@ void VMM::printPageTable() {
 } 
 
 void VMM::printSummary() {
-	for(int i = 0; i < procList.size(); i++) {
+	for(int i = 0; i < (int)procList.size(); i++) {
 		printf("PROC[%d]: U=%lu M=%lu I=%lu O=%lu FI=%lu FO=%lu Z=%lu SV=%lu SP=%lu\n",
 				procList[i]->pid,
 				procList[i]->pstats.unmaps, procList[i]->pstats.maps, procList[i]->pstats.ins, procList[i]->pstats.outs,
 				procList[i]->pstats.fins, procList[i]->pstats.fouts, procList[i]->pstats.zeros, procList[i]->pstats.segv, procList[i]->pstats.segprot);	
 	}
-	printf("TOTALCOST %lu %lu %llu\n", ctx_switches, inst_count, cost);
+	if(sharing) {
+		for(auto proc : procList)
+			printf("SHARE[%d]: CB=%lu SH=%lu\n", proc->pid, proc->pstats.cowbreaks, proc->pstats.sharedhits);
+	}
+	if(hugepages) {
+		for(auto proc : procList)
+			printf("HUGE[%d]: F=%lu M=%lu U=%lu PR=%lu DM=%lu FB=%lu\n", proc->pid, proc->pstats.hugefaults, proc->pstats.hugemaps,
+					proc->pstats.hugeunmaps, proc->pstats.promotions, proc->pstats.demotions, proc->pstats.hugefallbacks);
+	}
+	printf("TOTALCOST %d %d %llu\n", ctx_switches, inst_count, cost);
+	if(hugepages) //Cost of the huge page mappings and of everything else
+		printf("HUGECOST %llu %llu\n", huge_cost, cost - huge_cost);
+	if(readahead > 0 || low_watermark > 0) {
+		unsigned long maps = 0, readaheads = 0;
+		for(auto proc : procList) {
+			maps += proc->pstats.maps;
+			readaheads += proc->pstats.readaheads;
+		}
+		//F counts the faults that were actually taken, the other maps came in through read-ahead
+		printf("BATCH: F=%lu RA=%lu KS=%lu RC=%lu\n", maps - readaheads, readaheads, reclaim_batches, reclaimed);
+	}
+	if(swapDisk != NULL) {
+		unsigned long waits = swapDisk->reads - swapDisk->cache_hits;
+		printf("SWAP: %lu %lu %lu %lu %.2lf %lld\n", swapDisk->reads, swapDisk->writes, swapDisk->cache_hits, swapDisk->tot_movement,
+				waits ? (double)swapDisk->tot_latency / waits : 0.0, swapDisk->max_latency);
+	}
+	//Per memory group: limit, frames held at the end and at most, instructions, faults and faults per 1000 instructions,
+	//frames reclaimed from it and how many of those because it was at its limit
+	for(auto &cg : memcgs)
+		printf("MEMCG[%s]: L=%d N=%lu PK=%d I=%lu F=%lu FR=%.2lf RC=%lu LR=%lu\n", cg.name.c_str(), cg.limit, cg.frames.size(),
+				cg.peak, cg.instructions, cg.faults, cg.instructions ? 1000.0 * cg.faults / cg.instructions : 0.0, cg.reclaimed,
+				cg.limit_reclaims);
+}
+
+//Unmap the victim frame from every page mapping it and write it back once if any of them dirtied (modified) it
+void VMM::evict(Frame* frame, bool Oop) {
+	if(frame->pid == -1)
+		return;
+	if(frame->huge) //Only the victim page leaves, the rest of the run stays mapped by base pages
+		split_huge(frame, Oop);
+	bool dirty = false;
+	int vic_pid = frame->pid;
+	int vic_vpage = frame->vpage;
+	for(auto &owner : frame->rmap) {
+		PTE &vic_pte = procList[owner.first]->pageTable[owner.second];
+		//Unmap
+		vic_pte.PRESENT = 0;
+		procList[owner.first]->pstats.unmaps++;
+		cost += UNMAP;
+		if(Oop) {
+			cout<<" UNMAP "<<owner.first<<":"<<owner.second<<endl;
+		}
+		if(vic_pte.MODIFIED && !dirty) { //The writeback is accounted to the first writer
+			dirty = true;
+			vic_pid = owner.first;
+			vic_vpage = owner.second;
+		}
+	}
+	
+	//Check if the page was dirty (modified)
+	if(dirty) {
+		PTE &vic_pte = procList[vic_pid]->pageTable[vic_vpage];
+		Pstats &vic_pstats = procList[vic_pid]->pstats;
+		if(vic_pte.FILEMAPPED) {
+			vic_pstats.fouts++;
+			if(swapDisk != NULL)
+				swapDisk->write(page_key(vic_pid, vic_vpage), swap_track(vic_pid, vic_vpage, true), cost);
+			else
+				cost += FILE_OUT;
+			if(Oop) {
+				cout<<" FOUT"<<endl;
+			}
+		}
+		else {
+			for(auto &owner : frame->rmap)
+				procList[owner.first]->pageTable[owner.second].PAGEDOUT = 1;
+			if(frame->shmkey != -1)
+				shmPages[frame->shmkey].pagedout = true;
+			vic_pstats.outs++;
+			if(swapDisk != NULL)
+				swapDisk->write(page_key(vic_pid, vic_vpage), swap_track(vic_pid, vic_vpage, false), cost);
+			else
+				cost += PAGE_OUT;
+			if(Oop) {
+				cout<<" OUT"<<endl;
+			}
+		}
+		for(auto &owner : frame->rmap)
+			procList[owner.first]->pageTable[owner.second].MODIFIED = 0; //reset
+	}
+	if(frame->shmkey != -1) {
+		shmPages[frame->shmkey].frame = NULL;
+		frame->shmkey = -1;
+	}
+	frame->rmap.clear();
+	frame->refcount = 0;
+	frame->pid = -1;
+}
+
+//Pages of a shared VMA already resident for another process are mapped to the same frame
+bool VMM::map_shared(Process* proc, int vpage, VMA* vma, bool Oop) {
+	PTE &pte = proc->pageTable[vpage];
+	SharedPage &shm = shmPages[page_key(vma->shmid, vpage - vma->starting_virtual_page)];
+	if(shm.frame == NULL) {
+		pte.PAGEDOUT = shm.pagedout;
+		return false;
+	}
+	proc->pstats.sharedhits++;
+	proc->pstats.maps++;
+	cost += MAP;
+	pte.PRESENT = 1;
+	pte.FRAMEINDEX = shm.frame->index;
+	shm.frame->map(proc->pid, vpage);
+	if(Oop) {
+		cout<<" SHARE"<<endl;
+		cout<<" MAP "<<pte.FRAMEINDEX<<endl;
+	}
+	return true;
 }
 
-void VMM::paging(string infile, getRand *rand, string pagealg, bool Oop, bool Pop, bool Fop, bool Sop, int num_frames) {
+//Bring the faulting page into memory
+//Returns the frame it was filled into, NULL if it was found resident in a shared frame
+Frame* VMM::fault_in(Process* proc, int vpage, VMA* vma, bool readahead, bool Oop) {
+	if(vma->shmid != -1 && map_shared(proc, vpage, vma, Oop))
+		return NULL;
+	//2. Find free frame
+	//Page replacement
+	if(low_watermark > 0)
+		reclaim(Oop);
+	if(vma->huge && !readahead) {
+		Frame* frame = fault_huge(proc, vpage, vma, Oop);
+		if(frame != NULL)
+			return frame;
+	}
+	Frame* frame = select_frame(proc);
+	//Figure out if/what to do with old frame if it was mapped
+	evict(frame, Oop);
+		
+	//3.Swap page into frame via scheduled disk operation
+	//4.Reset tables to indicate page now in memorySet validation bit = v
+	page_in(proc, vpage, frame, readahead, Oop);
+	if(vma->shmid != -1) {
+		frame->shmkey = page_key(vma->shmid, vpage - vma->starting_virtual_page);
+		shmPages[frame->shmkey].frame = frame;
+	}
+	return frame;
+}
+
+//The child gets the next pid and shares every present page of its parent copy-on-write, shared VMAs stay shared
+//Huge pages of the parent are split first, COW works on base pages
+void VMM::fork_process(Process* parent, bool Oop) {
+	Process* child = new Process(procList.size());
+	child->vmalist = parent->vmalist;
+	for(auto &vma : parent->vmalist) {
+		for(int i = vma.starting_virtual_page; i <= vma.ending_virtual_page; i++) {
+			PTE &pte = parent->pageTable[i];
+			if(pte.HUGE)
+				split_huge(&frameTable->inverse_map[pte.FRAMEINDEX], Oop);
+			if(pte.PRESENT) {
+				if(vma.shmid == -1 && !pte.WRITE_PROTECT)
+					pte.COW = 1;
+				frameTable->inverse_map[pte.FRAMEINDEX].map(child->pid, i);
+			}
+			child->pageTable[i] = pte;
+		}
+	}
+	procList.push_back(child);
+	if(!memcgs.empty()) //cgroups are inherited
+		proc_memcg.push_back(memcgs[proc_memcg[parent->pid]].implicit ? add_memcg(to_string(child->pid), 0, true) : proc_memcg[parent->pid]);
+	sharing = true;
+	cost += FORK;
+}
+
+//First write to a page shared since fork: take a private copy unless no one else maps the frame anymore
+void VMM::cow_break(Process* proc, int vpage, bool Oop) {
+	PTE &pte = proc->pageTable[vpage];
+	Frame* old = &frameTable->inverse_map[pte.FRAMEINDEX];
+	pte.COW = 0;
+	if(old->refcount == 1)
+		return;
+	if(Oop) {
+		cout<<" COW"<<endl;
+	}
+	Frame* frame = select_frame(proc);
+	if(frame == old) //The pager chose the shared frame itself, the other mappings lose it instead
+		evict(old, Oop);
+	else {
+		evict(frame, Oop);
+		unsigned long key = page_key(old->pid, old->vpage);
+		old->unmap(proc->pid, vpage);
+		if(page_key(old->pid, old->vpage) != key) //The copy was the first owner
+			rekey_frame(old, key);
+		cost += COW_COPY;
+	}
+	proc->pstats.cowbreaks++;
+	proc->pstats.maps++;
+	cost += MAP;
+	pte.PRESENT = 1;
+	pte.FRAMEINDEX = frame->index;
+	frame->map(proc->pid, vpage);
+	if(Oop) {
+		cout<<" MAP "<<pte.FRAMEINDEX<<endl;
+	}
+	mapped_frame(frame);
+}
+
+//Fill the frame with the content of the virtual page and map it
+//Read-ahead pages ride on the seek of the faulting page and only pay for their transfer
+void VMM::page_in(Process* proc, int vpage, Frame* frame, bool readahead, bool Oop) {
+	PTE &pte = proc->pageTable[vpage];
+	Pstats &pstats = proc->pstats;
+	if(pte.PAGEDOUT) { //Page in
+		pstats.ins++;
+		if(swapDisk != NULL && readahead)
+			swapDisk->add_run(page_key(proc->pid, vpage), swap_track(proc->pid, vpage, false));
+		else if(swapDisk != NULL)
+			cost += swapDisk->read(page_key(proc->pid, vpage), swap_track(proc->pid, vpage, false), cost);
+		else
+			cost += readahead ? PAGE_XFER : PAGE_IN;
+		if(Oop) {
+			cout<<" IN"<<endl;
+		}
+	}
+	else if(pte.FILEMAPPED) { //File in
+		pstats.fins++;
+		if(swapDisk != NULL && readahead)
+			swapDisk->add_run(page_key(proc->pid, vpage), swap_track(proc->pid, vpage, true));
+		else if(swapDisk != NULL)
+			cost += swapDisk->read(page_key(proc->pid, vpage), swap_track(proc->pid, vpage, true), cost);
+		else
+			cost += readahead ? PAGE_XFER : FILE_IN;
+		if(Oop) {
+			cout<<" FIN"<<endl;
+		}
+	}
+	else { //Zeroed
+		pstats.zeros++;
+		cost += ZERO;
+		if(Oop) {
+			cout<<" ZERO"<<endl;
+		}
+	}
+		
+	//Map
+	pstats.maps++;
+	cost += MAP;
+	pte.PRESENT = 1;
+	pte.FRAMEINDEX = frame->index;
+	pte.COW = 0;
+	frame->map(proc->pid, vpage);
+	if(Oop) {
+		cout<<" MAP "<<pte.FRAMEINDEX<<endl;
+	}
+}
+
+//Bring in the next pages of the faulting VMA that are not present yet
+//Only the free frames kswapd keeps are filled, so neither the faulting page nor the pages read ahead with it are replaced,
+//and only pages with content on disk are worth it. It stops short of waking kswapd. On the swap disk the run is one read.
+void VMM::read_ahead(Process* proc, int vpage, VMA* vma, bool Oop) {
+	int last = min(vpage + readahead, (int)vma->ending_virtual_page);
+	for(int page = vpage + 1; page <= last; page++) {
+		if((int)frameTable->free_list.size() <= low_watermark)
+			break;
+		PTE &pte = proc->pageTable[page];
+		if(pte.PRESENT)
+			continue;
+		pte.WRITE_PROTECT = vma->write_protected;
+		pte.FILEMAPPED = vma->filemapped;
+		if(!pte.PAGEDOUT && !pte.FILEMAPPED) //Zero filled on demand for free
+			continue;
+		if(Oop) {
+			cout<<" RA "<<page<<endl;
+		}
+		Frame* frame = fault_in(proc, page, vma, true, Oop);
+		proc->pstats.readaheads++;
+		if(frame != NULL)
+			mapped_frame(frame);
+	}
+	if(swapDisk != NULL)
+		cost += swapDisk->read_run(cost);
+}
+
+//kswapd: once the free frames drop below the low watermark, reclaim a batch of victims up to the high watermark
+void VMM::reclaim(bool Oop) {
+	if((int)frameTable->free_list.size() >= low_watermark)
+		return;
+	reclaim_batches++;
+	frameTable->reclaiming = true; //The pagers must pick victims, not free frames
+	while((int)frameTable->free_list.size() < high_watermark) {
+		Frame* frame = pager->select_frame(procList, frameTable);
+		evict(frame, Oop);
+		pager->free_frame(frame);
+		frameTable->put_frame(frame);
+		reclaimed++;
+	}
+	frameTable->reclaiming = false;
+}
+
+//An anonymous fault whose whole aligned run is untouched is served by zeroing a huge frame
+//Returns NULL when the run does not qualify or no aligned run of free frames is left
+Frame* VMM::fault_huge(Process* proc, int vpage, VMA* vma, bool Oop) {
+	int base = vpage - vpage % HUGE_PAGES;
+	if(base < vma->starting_virtual_page || base + HUGE_PAGES - 1 > vma->ending_virtual_page)
+		return NULL;
+	for(int i = base; i < base + HUGE_PAGES; i++) {
+		PTE &pte = proc->pageTable[i];
+		if(pte.PRESENT || pte.PAGEDOUT)
+			return NULL;
+	}
+	Frame* frame = frameTable->get_huge_frame();
+	if(frame == NULL) {
+		proc->pstats.hugefallbacks++;
+		return NULL;
+	}
+	proc->pstats.hugefaults++;
+	cost += HUGE_ZERO;
+	huge_cost += HUGE_ZERO;
+	if(Oop) {
+		cout<<" HZERO"<<endl;
+	}
+	for(int i = base; i < base + HUGE_PAGES; i++) {
+		proc->pageTable[i].WRITE_PROTECT = vma->write_protected;
+		proc->pageTable[i].FILEMAPPED = 0;
+	}
+	map_huge(proc, base, frame, Oop);
+	return frame;
+}
+
+//Map the aligned run starting at base to the huge frame, one page table entry per base page points into the run
+void VMM::map_huge(Process* proc, int base, Frame* frame, bool Oop) {
+	for(int i = 0; i < HUGE_PAGES; i++) {
+		PTE &pte = proc->pageTable[base + i];
+		pte.PRESENT = 1;
+		pte.HUGE = 1;
+		pte.COW = 0;
+		pte.FRAMEINDEX = frame->index + i;
+		if(i > 0)
+			frameTable->inverse_map[frame->index + i].head = frame;
+	}
+	frame->huge = true;
+	frame->map(proc->pid, base);
+	proc->pstats.hugemaps++;
+	cost += MAP;
+	huge_cost += MAP;
+	pager->adopt_frame(frame);
+	if(Oop) {
+		cout<<" HMAP "<<frame->index<<endl;
+	}
+}
+
+//Demote a huge page: every frame of the run becomes a base frame of its own, known to the pager
+void VMM::split_huge(Frame* frame, bool Oop) {
+	Process* proc = procList[frame->pid];
+	int base = frame->vpage;
+	frame->huge = false;
+	for(int i = 0; i < HUGE_PAGES; i++) {
+		proc->pageTable[base + i].HUGE = 0;
+		if(i > 0) {
+			Frame* tail = &frameTable->inverse_map[frame->index + i];
+			tail->head = NULL;
+			tail->map(proc->pid, base + i);
+			pager->adopt_frame(tail);
+			pager->mapped_frame(tail, procList);
+		}
+	}
+	proc->pstats.demotions++;
+	proc->pstats.hugeunmaps++;
+	cost += HUGE_SPLIT;
+	huge_cost += HUGE_SPLIT;
+	if(Oop) {
+		cout<<" SPLIT "<<proc->pid<<":"<<base<<endl;
+	}
+}
+
+//khugepaged: collapse aligned runs of present private base pages into huge pages while aligned free runs are left
+void VMM::khugepaged(bool Oop) {
+	for(auto proc : procList) {
+		for(auto &vma : proc->vmalist) {
+			if(!vma.huge)
+				continue;
+			int first = (vma.starting_virtual_page + HUGE_PAGES - 1) / HUGE_PAGES * HUGE_PAGES;
+			for(int base = first; base + HUGE_PAGES - 1 <= vma.ending_virtual_page; base += HUGE_PAGES) {
+				bool collapse = true;
+				for(int i = base; i < base + HUGE_PAGES && collapse; i++) {
+					PTE &pte = proc->pageTable[i];
+					collapse = pte.PRESENT && !pte.HUGE && !pte.COW && frameTable->inverse_map[pte.FRAMEINDEX].refcount == 1;
+				}
+				if(!collapse)
+					continue;
+				Frame* frame = frameTable->get_huge_frame();
+				if(frame == NULL)
+					return;
+				if(Oop) {
+					cout<<" COLLAPSE "<<proc->pid<<":"<<base<<endl;
+				}
+				//Copy the base pages over and release their frames
+				for(int i = base; i < base + HUGE_PAGES; i++) {
+					Frame* old = &frameTable->inverse_map[proc->pageTable[i].FRAMEINDEX];
+					pager->free_frame(old);
+					frameTable->put_frame(old);
+					proc->pstats.unmaps++;
+					cost += UNMAP;
+					if(Oop) {
+						cout<<" UNMAP "<<proc->pid<<":"<<i<<endl;
+					}
+				}
+				proc->pstats.promotions++;
+				cost += HUGE_COPY;
+				huge_cost += HUGE_COPY;
+				map_huge(proc, base, frame, Oop);
+				pager->mapped_frame(frame, procList);
+			}
+		}
+	}
+}
+
+void VMM::paging(string infile, getRand *rand, string pagealg, string diskalg, bool Oop, bool Pop, bool Fop, bool Sop, int num_frames,
+		int readahead, int low_watermark, int high_watermark, int khugepaged_period) {
 	//readInputFile(infile);
 	//Process instructions while reading
 	ifstream input;
 	input.open(infile.c_str());
 	string line;
 	char instr;
-	int num_proc, num_VMA, vpage, start_page, end_page, write_prot, file_map;
+	int num_proc, num_VMA, vpage, start_page, end_page, write_prot, file_map, shm_id, huge_page;
 	while(getline(input, line) && line[0] == '#'); //All lines starting with '#' must be ignored
 	//First line not starting with a '#' is the number of processes
 	num_proc = atoi(line.c_str());
@@ -504,40 +1946,98 @@ void VMM::paging(string infile, getRand *rand, string pagealg, bool Oop, bool Po
 			getline(input, line);
 			stringstream split(line);
 			split >> start_page >> end_page >> write_prot >> file_map;
-			VMA vma = VMA(start_page, end_page, write_prot, file_map);
+			if(!(split >> shm_id)) //Optional id of a shared memory segment
+				shm_id = -1;
+			else if(shm_id != -1)
+				sharing = true;
+			if(!(split >> huge_page)) //Optional huge page eligibility
+				huge_page = 0;
+			VMA vma = VMA(start_page, end_page, write_prot, file_map, shm_id, huge_page);
+			if(vma.huge)
+				hugepages = true;
 			proc->vmalist.push_back(vma);
 		}
 		procList.push_back(proc);
 	}
-	char alg = pagealg[0];
+	if(num_frames <= 0) {
+		fprintf(stderr, "-f<num_frames> needs at least one frame\n");
+		exit(1);
+	}
 	//Choose paging algorithm 
-	if(alg == 'f')
-		pager = new FIFO();
-	if(alg == 's')
-		pager = new SC();
-	if(alg == 'r')
-		pager = new Random(rand);
-	if(alg == 'n')
-		pager = new NRU(rand);
-	if(alg == 'c')
-		pager = new Clock();
-	if(alg == 'a')
-		pager = new Aging(num_frames);
+	this->pagealg = pagealg.empty() ? 0 : pagealg[0];
+	this->num_frames = num_frames;
+	this->rand = rand;
+	if(!local_replacement)
+		pager = new_pager(num_frames);
+	if(readahead > 0 && low_watermark <= 0) {
+		fprintf(stderr, "read-ahead only fills the free frames kswapd keeps, -r needs -k\n");
+		exit(1);
+	}
+	if(!memcg_file.empty() || local_replacement) {
+		if(low_watermark > 0 || readahead > 0 || khugepaged_period > 0 || hugepages) {
+			fprintf(stderr, "memory groups do not cover kswapd, read-ahead, khugepaged or huge pages\n");
+			exit(1);
+		}
+		load_memcgs();
+	}
+	if(pager == NULL && (memcgs.empty() || memcgs[0].pager == NULL)) {
+		fprintf(stderr, "Unknown paging algorithm '%s'\n", pagealg.c_str());
+		exit(1);
+	}
 		
 	frameTable = new FrameTable(num_frames);
+	this->readahead = readahead;
+	this->khugepaged_period = khugepaged_period;
+	if(low_watermark > 0) {
+		this->high_watermark = min(max(high_watermark, low_watermark), num_frames - 1);
+		this->low_watermark = min(low_watermark, this->high_watermark);
+	}
+	if(!diskalg.empty()) {
+		iosched::IOScheduler* IOsche = iosched::newIOScheduler(diskalg[0]);
+		if(IOsche == NULL) {
+			fprintf(stderr, "Unknown IO scheduler '%s'\n", diskalg.c_str());
+			exit(1);
+		}
+		swapDisk = new SwapDisk(IOsche);
+	}
 	//int totalIns = insList.size();
 	
+	Process* cur_proc = NULL;
+	if(!restore_file.empty()) { //The header has been read again, continue at the instruction saved
+		long offset;
+		Checkpoint ck(restore_file, false, 'M');
+		snapshot(ck, pagealg, diskalg, offset, cur_proc);
+		ck.close();
+		input.seekg(offset);
+	}
+	int resumed_at = inst_count;
 	while(getline(input, line)) {
 		//Instruction* ins = get_next_instruction(); 
 		if(!line.empty() && line[0] != '#') {
+			if(checkpoint_every > 0 && inst_count % checkpoint_every == 0 && inst_count != resumed_at) {
+				//Offset of this line, the last line may end without a newline
+				long offset;
+				if(input.eof()) {
+					input.clear();
+					input.seekg(0, ios::end);
+					offset = (long)input.tellg() - line.size();
+					input.setstate(ios::eofbit);
+				}
+				else
+					offset = (long)input.tellg() - line.size() - 1;
+				Checkpoint ck(checkpoint_file, true, 'M');
+				snapshot(ck, pagealg, diskalg, offset, cur_proc);
+				ck.close();
+			}
 			stringstream split(line);
 			split >> instr >> vpage;			
 			//char instr = ins->instruction;
-			Process* cur_proc;
 			if(Oop) {
 				cout << inst_count << ": ==> " << instr << " " << vpage << endl;
 			}
 			inst_count++;
+			if(khugepaged_period > 0 && inst_count % khugepaged_period == 0)
+				khugepaged(Oop);
 			
 			//First instruction is a context switch, a pointer to the page table
 			if(instr == 'c') {
@@ -548,10 +2048,19 @@ void VMM::paging(string infile, getRand *rand, string pagealg, bool Oop, bool Po
 				continue;
 			}
 			
+			if(instr == 'f') { //Fork the current process
+				fork_process(cur_proc, Oop);
+				continue;
+			}
+			
 			//int vpage = ins->virtual_page;
 			PTE &pte = cur_proc->pageTable[vpage];
 			Pstats &pstats = cur_proc->pstats;
+			Frame* mapped = NULL;
+			VMA* area = NULL;
 			cost += READ_WRITE;
+			if(!memcgs.empty())
+				memcgs[proc_memcg[cur_proc->pid]].instructions++;
 			//Check the page is present
 			if(!pte.PRESENT) {
 			//Page fault
@@ -563,6 +2072,7 @@ void VMM::paging(string infile, getRand *rand, string pagealg, bool Oop, bool Po
 						pte.WRITE_PROTECT = vma.write_protected;
 						pte.FILEMAPPED = vma.filemapped;
 						find = 1;
+						area = &vma;
 						break;
 					}
 				}
@@ -576,80 +2086,9 @@ void VMM::paging(string infile, getRand *rand, string pagealg, bool Oop, bool Po
 					continue; //Get next instruction
 				}
 				
-				//2. Find free frame
-				//Page replacement
-				Frame* frame = pager->select_frame(procList, frameTable);
-				int vic_pid = frame->pid;
-				int vic_vpage = frame->vpage;
-				//cout<<"select"<<vic_pid;
-				//Figure out if/what to do with old frame if it was mapped
-				if(vic_pid != -1) {
-					PTE &vic_pte = procList[vic_pid]->pageTable[vic_vpage];
-					Pstats &vic_pstats = procList[vic_pid]->pstats;
-					//Unmap
-					vic_pte.PRESENT = 0;
-					vic_pstats.unmaps++;
-					cost += UNMAP;
-					if(Oop) {
-						cout<<" UNMAP "<<vic_pid<<":"<<vic_vpage<<endl;
-					}
-					
-					//Check if the page was dirty (modified)
-					if(vic_pte.MODIFIED) {
-						if(vic_pte.FILEMAPPED) {
-							vic_pstats.fouts++;
-							cost += FILE_OUT;
-							if(Oop) {
-								cout<<" FOUT"<<endl;
-							}
-						}
-						else {
-							vic_pte.PAGEDOUT = 1;
-							vic_pstats.outs++;
-							cost += PAGE_OUT;
-							if(Oop) {
-								cout<<" OUT"<<endl;
-							}
-						}
-						vic_pte.MODIFIED = 0; //reset
-					}
-				}
-					
-				//3.Swap page into frame via scheduled disk operation
-				if(pte.PAGEDOUT) { //Page in
-					pstats.ins++;
-					cost += PAGE_IN;
-					if(Oop) {
-						cout<<" IN"<<endl;
-					}
-				}
-				else if(pte.FILEMAPPED) { //File in
-					pstats.fins++;
-					cost += FILE_IN;
-					if(Oop) {
-						cout<<" FIN"<<endl;
-					}
-				}
-				else { //Zeroed
-					pstats.zeros++;
-					cost += ZERO;
-					if(Oop) {
-						cout<<" ZERO"<<endl;
-					}
-				}
-					
-				//Map
-				pstats.maps++;
-				cost += MAP;
-				
-				//4.Reset tables to indicate page now in memorySet validation bit = v
-				pte.PRESENT = 1;
-				pte.FRAMEINDEX = frame->index;
-				frame->pid = cur_proc->pid;
-				frame->vpage = vpage;
-				if(Oop) {
-					cout<<" MAP "<<pte.FRAMEINDEX<<endl;
-				}
+				if(!memcgs.empty())
+					memcgs[proc_memcg[cur_proc->pid]].faults++;
+				mapped = fault_in(cur_proc, vpage, area, false, Oop);
 				//5.Restart the instruction that caused the page fault
 			}
 			
@@ -664,9 +2103,16 @@ void VMM::paging(string infile, getRand *rand, string pagealg, bool Oop, bool Po
 					}
 				}
 				else {
+					if(pte.COW)
+						cow_break(cur_proc, vpage, Oop);
 					pte.MODIFIED = 1;
 				}
 			}
+			if(mapped != NULL) {
+				mapped_frame(mapped);
+				if(readahead > 0)
+					read_ahead(cur_proc, vpage, area, Oop);
+			}
 		}	
 	}
 	//Print options
@@ -678,15 +2124,123 @@ void VMM::paging(string infile, getRand *rand, string pagealg, bool Oop, bool Po
 		printSummary();
 }
 
+//Everything the instruction loop depends on between two instructions: the page tables, the frame table and the
+//shared pages, the pager and the swap disk, the costs and the position in the input and random files.
+//The processes are read again from the header of the same input file, forked ones are created here.
+void VMM::snapshot(Checkpoint &ck, string pagealg, string diskalg, long &offset, Process* &cur_proc) {
+	char algs[2] = {pagealg.empty() ? (char)0 : pagealg[0], diskalg.empty() ? (char)0 : diskalg[0]};
+	char ck_algs[2] = {algs[0], algs[1]};
+	long num_frames = frameTable->inverse_map.size(), num_procs = procList.size();
+	ck.io(ck_algs);
+	ck.io(num_frames);
+	ck.io(num_procs);
+	if(ck_algs[0] != algs[0] || ck_algs[1] != algs[1])
+		ck.fail("written with another paging algorithm or IO scheduler");
+	if(num_frames != (long)frameTable->inverse_map.size())
+		ck.fail("written with another number of frames");
+	if(num_procs < (long)procList.size())
+		ck.fail("written with another input file");
+	rand->checkpoint(ck);
+	ck.io(offset);
+	ck.io(inst_count);
+	ck.io(ctx_switches);
+	ck.io(cost);
+	ck.io(reclaim_batches);
+	ck.io(reclaimed);
+	ck.io(huge_cost);
+	ck.io(sharing);
+	while((long)procList.size() < num_procs)
+		procList.push_back(new Process(procList.size()));
+	for(auto proc : procList) {
+		ck.io(proc->vmalist);
+		ck.io(proc->pageTable);
+		ck.io(proc->pstats);
+	}
+	Index<Process> procs;
+	procs.id_of = [](Process* proc) { return (long)proc->pid; };
+	procs.at = [&](long id) { return procList[id]; };
+	ck.ref(cur_proc, procs);
+	Index<Frame> frames;
+	frames.id_of = [](Frame* frame) { return (long)frame->index; };
+	frames.at = [&](long id) { return &frameTable->inverse_map[id]; };
+	for(auto &frame : frameTable->inverse_map) {
+		ck.io(frame.pid);
+		ck.io(frame.vpage);
+		ck.io(frame.refcount);
+		ck.io(frame.shmkey);
+		ck.io(frame.free);
+		ck.io(frame.huge);
+		ck.ref(frame.head, frames);
+		long num_maps = frame.rmap.size();
+		ck.io(num_maps);
+		frame.rmap.resize(num_maps);
+		for(auto &owner : frame.rmap) {
+			ck.io(owner.first);
+			ck.io(owner.second);
+		}
+	}
+	ck.refs(frameTable->free_list, frames);
+	ck.io(frameTable->reclaiming);
+	long num_shared = shmPages.size();
+	ck.io(num_shared);
+	auto entry = shmPages.begin();
+	if(!ck.saving)
+		shmPages.clear();
+	for(long i = 0; i < num_shared; i++) {
+		long key = ck.saving ? entry->first : 0;
+		SharedPage shm = ck.saving ? (entry++)->second : SharedPage();
+		ck.io(key);
+		ck.ref(shm.frame, frames);
+		ck.io(shm.pagedout);
+		if(!ck.saving)
+			shmPages[key] = shm;
+	}
+	if(pager != NULL)
+		pager->checkpoint(ck, frames);
+	long num_memcgs = memcgs.size();
+	bool ck_local = local_replacement;
+	ck.io(num_memcgs);
+	ck.io(ck_local);
+	if(ck_local != local_replacement || (num_memcgs == 0) != memcgs.empty())
+		ck.fail("written with other memory groups");
+	while((long)memcgs.size() < num_memcgs) //Groups of forked children
+		add_memcg("", 0, true);
+	for(auto &cg : memcgs) {
+		vector<char> name(cg.name.begin(), cg.name.end());
+		ck.io(name);
+		cg.name.assign(name.begin(), name.end());
+		ck.io(cg.limit);
+		ck.io(cg.implicit);
+		ck.io(cg.peak);
+		ck.io(cg.instructions);
+		ck.io(cg.faults);
+		ck.io(cg.reclaimed);
+		ck.io(cg.limit_reclaims);
+		ck.refs(cg.frames, frames);
+		if(cg.pager != NULL)
+			cg.pager->checkpoint(ck, frames);
+	}
+	ck.io(proc_memcg);
+	for(int g = 0; !ck.saving && g < (int)memcgs.size(); g++) {
+		for(int i = 0; i < (int)memcgs[g].frames.size(); i++) {
+			frame_memcg[memcgs[g].frames[i]->index] = g;
+			frame_pos[memcgs[g].frames[i]->index] = i;
+		}
+	}
+	if(swapDisk != NULL)
+		swapDisk->checkpoint(ck);
+}
 
 int main(int argc, char* argv[]) {
-	string alg, opt, fnum;
+	string alg, opt, fnum, diskalg;
+	int readahead = 0, low_watermark = 0, high_watermark = 0, khugepaged_period = 0;
 	bool Oop = 0, Pop = 0, Fop = 0, Sop = 0;
-	int c, num_frames;
+	int c, num_frames = 0;
+	VMM sim;
 	
 	//Provide optional arguments in arbitrary order
 	//https://www.gnu.org/software/libc/manual/html_node/Example-of-Getopt.html
-	while((c = getopt(argc, argv, "a:o:f:")) != -1) {
+	while((c = getopt(argc, argv, "a:o:f:d:r:k:H:c:R:M:L")) != -1) {
 		switch(c) {
 			case 'a': //[-a<algo>]
 				alg = optarg;
@@ -702,8 +2256,37 @@ int main(int argc, char* argv[]) {
 				fnum = optarg;
 				num_frames = atoi(fnum.c_str());
 				break;
+			case 'd': //[-d<iosched>] queue swap IO on a simulated disk
+				diskalg = optarg;
+				break;
+			case 'r': //[-r<pages>] read-ahead behind each fault
+				readahead = atoi(optarg);
+				break;
+			case 'k': //[-k<low>:<high>] free frame watermarks for batched reclaim
+				sscanf(optarg, "%d:%d", &low_watermark, &high_watermark);
+				break;
+			case 'H': //[-H<instructions>] period of the khugepaged promotion pass
+				khugepaged_period = atoi(optarg);
+				break;
+			case 'c': { //[-c<instructions>:<file>] checkpoint every so many instructions
+				char path[4096];
+				if(sscanf(optarg, "%d:%4095s", &sim.checkpoint_every, path) == 2)
+					sim.checkpoint_file = path;
+				else
+					sim.checkpoint_every = 0;
+				break;
+			}
+			case 'R': //[-R<file>] resume from a checkpoint of a run on the same input file
+				sim.restore_file = optarg;
+				break;
+			case 'M': //[-M<file>] memory groups with frame limits, see MemCG
+				sim.memcg_file = optarg;
+				break;
+			case 'L': //[-L] local replacement within the memory group of the faulting process
+				sim.local_replacement = true;
+				break;
 			case '?':
- 	      	 	if (optopt == 'a' || optopt == 'o' || optopt == 'f')
+ 	      	 	if (optopt == 'a' || optopt == 'o' || optopt == 'f' || optopt == 'd' || optopt == 'r' || optopt == 'k' || optopt == 'H' || optopt == 'c' || optopt == 'R' || optopt == 'M')
     	      		fprintf (stderr, "Option -%c requires an argument.\n", optopt);
         		else if (isprint (optopt))
           			fprintf (stderr, "Unknown option `-%c'.\n", optopt);
@@ -716,8 +2299,7 @@ int main(int argc, char* argv[]) {
 	}
 	
 	getRand rand(argv[optind + 1]);
-    VMM sim;
-    sim.paging(argv[optind], &rand, alg, Oop, Pop, Fop, Sop, num_frames);
+    sim.paging(argv[optind], &rand, alg, diskalg, Oop, Pop, Fop, Sop, num_frames, readahead, low_watermark, high_watermark, khugepaged_period);
     
     return 0;
 }
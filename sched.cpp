@@ -3,13 +3,35 @@
 #include <sstream>
 #include <unistd.h>
 #include <cstdio>
+#include <cstdlib>
 #include <cstring>
 #include <list>
 #include <array>
 #include <vector>
 #include <climits>
+#include <atomic>
+#include <thread>
+#include <functional>
+#include <cmath>
+#include <type_traits>
+#include <chrono>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#include "workload.h"
+#include "trace.h"
+#include "checkpoint.h"
+#include "stats.h"
+#include "iosched.h"
 using namespace std;
 
+//Timeline probes, compiled in with -DDES_TRACE and switched on with -t<file>. Without DES_TRACE they expand to nothing.
+#ifdef DES_TRACE
+#define TRACE_STATE(proc, now, cause) if(tracer != NULL) trace_state(proc, now, cause)
+#else
+#define TRACE_STATE(proc, now, cause)
+#endif
+
 typedef enum { 
 	STATE_CREATED,
 	STATE_READY,
@@ -22,57 +44,248 @@ typedef enum {
 	TRANS_TO_READY,
 	TRANS_TO_RUN,
 	TRANS_TO_BLOCK,
-	TRANS_TO_PREEMPT
+	TRANS_TO_PREEMPT,
+	TRANS_TO_UNTHROTTLE, //proc is the group
+	TRANS_TO_IO_IDLE //proc is the device
 } transition_t; 
+
+const char* state_names[] = {"CREATED", "READY", "RUNNING", "BLOCKED", "FINISHED"};
+const char* transition_names[] = {"TRANS_TO_READY", "TRANS_TO_RUN", "TRANS_TO_BLOCK", "TRANS_TO_PREEMPT", "TRANS_TO_UNTHROTTLE", "TRANS_TO_IO_IDLE"};
  
-struct Process {
-    int pid; //process identifier
-    process_state_t state; //process state
-    int AT; //arrival time
-    int TC; //total CPU time
-    int CB; //CPU burst
-    int IO; //I/O burst
-    int FT; //finishing time
-    int TT; //turnaround time
-    int IT; //I/O time
-    int CW; //CPU waiting time
-    int SPrio; //static priority
-    int DPrio; //dynamic priority
-    int TC_remain; //remaining total execution time
-    int CB_remain; //remaining CPU burst time
-    int timeInPrevState; //time in previous state 
-    int state_ts; //time at current state
-	Process(int procid, process_state_t procstate, int at, int tc, int cb, int io, int prio);
+//Process table
+//The processes are kept in arrays indexed by their slot, one array per field. The fields the event loop and the
+//scheduling decisions touch on every transition are kept apart from the burst limits and the accounting, so a
+//runqueue scan or a transition pulls in only the arrays it needs. Runqueues and events carry 32-bit slots. A process
+//read from the input file has its pid as slot, a generated one reuses the slot of a retired process so the table
+//grows with the processes in flight only.
+class ProcessTable {
+	public:
+		//Hot
+		vector<int> TC_remain; //remaining total execution time
+		vector<int> CB_remain; //remaining CPU burst time
+		vector<int> DPrio; //dynamic priority
+		vector<process_state_t> state; //process state
+		vector<int> state_ts; //time at current state
+		vector<int> next, prev; //runqueue links, -1 at the ends
+		//Cold
+		vector<int> pid; //process identifier
+		vector<int> AT; //arrival time
+		vector<int> TC; //total CPU time
+		vector<int> CB; //CPU burst
+		vector<int> IO; //I/O burst
+		vector<int> FT; //finishing time
+		vector<int> TT; //turnaround time
+		vector<int> IT; //I/O time
+		vector<int> CW; //CPU waiting time
+		vector<int> SPrio; //static priority
+		vector<int> timeInPrevState; //time in previous state 
+		vector<int> client; //closed loop client that issued it, -1 otherwise
+		vector<int> group; //control group, 0 for the root
+		vector<long long> energy; //uJ spent running its bursts, with the energy model
+		ProcessTable();
+		int add(int procid, process_state_t procstate, int at, int tc, int cb, int io, int prio);
+		void release(int slot);
+		int size();
+		void checkpoint(Checkpoint &ck);
+	private:
+		vector<int> free_slots;
 };
 
-Process::Process(int procid, process_state_t procstate, int at, int tc, int cb, int io, int prio) {
-	pid = procid;
-	state = procstate;
-	AT = at;
-	TC = tc;
-	CB = cb;
-	IO = io;
-	FT = 0;
-	TT = 0;
-	IT = 0;
-	CW = 0;
+ProcessTable::ProcessTable() {
+	
+}
+
+int ProcessTable::add(int procid, process_state_t procstate, int at, int tc, int cb, int io, int prio) {
+	int slot;
+	if(!free_slots.empty()) {
+		slot = free_slots.back();
+		free_slots.pop_back();
+	}
+	else {
+		slot = size();
+		for(auto field : {&TC_remain, &CB_remain, &DPrio, &state_ts, &next, &prev, &pid, &AT, &TC, &CB, &IO, &FT, &TT, &IT, &CW,
+				&SPrio, &timeInPrevState, &client, &group})
+			field->push_back(0);
+		state.push_back(STATE_CREATED);
+		energy.push_back(0);
+	}
+	pid[slot] = procid;
+	state[slot] = procstate;
+	AT[slot] = at;
+	TC[slot] = tc;
+	CB[slot] = cb;
+	IO[slot] = io;
+	FT[slot] = 0;
+	TT[slot] = 0;
+	IT[slot] = 0;
+	CW[slot] = 0;
 	//important initialization
-	SPrio = prio;
-	DPrio = prio - 1; //***
-	TC_remain = tc; //***
-	CB_remain = 0;
-	timeInPrevState = 0;
-	state_ts = at; //***
+	SPrio[slot] = prio;
+	DPrio[slot] = prio - 1; //***
+	TC_remain[slot] = tc; //***
+	CB_remain[slot] = 0;
+	timeInPrevState[slot] = 0;
+	state_ts[slot] = at; //***
+	client[slot] = -1;
+	group[slot] = 0;
+	energy[slot] = 0;
+	next[slot] = -1;
+	prev[slot] = -1;
+	return slot;
+}
+
+void ProcessTable::release(int slot) {
+	free_slots.push_back(slot);
+}
+
+int ProcessTable::size() {
+	return pid.size();
+}
+
+void ProcessTable::checkpoint(Checkpoint &ck) {
+	for(auto field : {&TC_remain, &CB_remain, &DPrio, &state_ts, &next, &prev, &pid, &AT, &TC, &CB, &IO, &FT, &TT, &IT, &CW,
+			&SPrio, &timeInPrevState, &client, &group, &free_slots})
+		ck.io(*field);
+	ck.io(state);
+	ck.io(energy);
+}
+
+//Runqueue primitives, neither allocates when a process is enqueued or dequeued
+//A RunList is a doubly linked list threaded through the next/prev links of the process table. A process waits on one
+//runqueue at a time, so one pair of links serves every list. A RunRing is a circular buffer of slots that only
+//allocates when it outgrows its capacity, which then doubles.
+class RunList {
+	public:
+		int head, tail;
+		RunList(ProcessTable* procs = NULL);
+		bool empty();
+		void push_back(int proc);
+		void insert_before(int pos, int proc); //pos -1 appends
+		int pop_front();
+		int pop_back();
+		int next(int proc);
+	private:
+		ProcessTable* procs;
+};
+
+RunList::RunList(ProcessTable* procs) : procs(procs) {
+	head = -1;
+	tail = -1;
+}
+
+bool RunList::empty() {
+	return head < 0;
+}
+
+void RunList::push_back(int proc) {
+	insert_before(-1, proc);
+}
+
+void RunList::insert_before(int pos, int proc) {
+	int before = pos < 0 ? tail : procs->prev[pos];
+	procs->prev[proc] = before;
+	procs->next[proc] = pos;
+	if(before < 0)
+		head = proc;
+	else
+		procs->next[before] = proc;
+	if(pos < 0)
+		tail = proc;
+	else
+		procs->prev[pos] = proc;
+}
+
+int RunList::pop_front() {
+	int proc = head;
+	head = procs->next[proc];
+	if(head < 0)
+		tail = -1;
+	else
+		procs->prev[head] = -1;
+	return proc;
+}
+
+int RunList::pop_back() {
+	int proc = tail;
+	tail = procs->prev[proc];
+	if(tail < 0)
+		head = -1;
+	else
+		procs->next[tail] = -1;
+	return proc;
+}
+
+int RunList::next(int proc) {
+	return procs->next[proc];
+}
+
+class RunRing {
+	public:
+		RunRing();
+		bool empty();
+		void push_back(int proc);
+		int pop_front();
+		int pop_back();
+		void checkpoint(Checkpoint &ck);
+	private:
+		vector<int> slots; //size is a power of two
+		unsigned first, count;
+};
+
+RunRing::RunRing() : slots(16) {
+	first = 0;
+	count = 0;
+}
+
+bool RunRing::empty() {
+	return count == 0;
+}
+
+void RunRing::push_back(int proc) {
+	if(count == slots.size()) {
+		vector<int> grown(2 * slots.size());
+		for(unsigned i = 0; i < count; i++)
+			grown[i] = slots[(first + i) & (slots.size() - 1)];
+		slots.swap(grown);
+		first = 0;
+	}
+	slots[(first + count) & (slots.size() - 1)] = proc;
+	count++;
+}
+
+int RunRing::pop_front() {
+	int proc = slots[first];
+	first = (first + 1) & (slots.size() - 1);
+	count--;
+	return proc;
+}
+
+int RunRing::pop_back() {
+	count--;
+	return slots[(first + count) & (slots.size() - 1)];
+}
+
+void RunRing::checkpoint(Checkpoint &ck) {
+	vector<int> queued;
+	for(unsigned i = 0; ck.saving && i < count; i++)
+		queued.push_back(slots[(first + i) & (slots.size() - 1)]);
+	ck.io(queued);
+	if(!ck.saving) {
+		first = 0;
+		count = 0;
+		for(auto proc : queued)
+			push_back(proc);
+	}
 }
 
 struct Event {
 	int time_stamp;
 	transition_t transition;
-	Process* proc;
-	Event(Process* proc, int time_stamp, transition_t transition); //Time ordered
+	int proc; //slot in the process table
+	Event(int proc, int time_stamp, transition_t transition); //Time ordered
 };
 
-Event::Event(Process* p, int ts, transition_t trans) {
+Event::Event(int p, int ts, transition_t trans) {
 	time_stamp = ts;
 	proc = p;
 	transition = trans;
@@ -81,162 +294,172 @@ Event::Event(Process* p, int ts, transition_t trans) {
 //Scheduling algorithms
 class Scheduler {
 	public:
-		virtual void add_process(Process* proc) {}
-		virtual Process* get_next_process() {}
+		virtual void add_process(int proc) {}
+		virtual int get_next_process() { return -1; } //-1 when the runqueue is empty
+		virtual void checkpoint(Checkpoint &ck) {}
 };
 
 //First Come First Served
-class FCFS : public Scheduler {
+class FCFS final : public Scheduler {
 	public:
 		FCFS();
-		void add_process(Process* proc);
-		Process* get_next_process();
+		void add_process(int proc);
+		int get_next_process();
+		void checkpoint(Checkpoint &ck);
 	private:
-		list<Process*> runqueue;
+		RunRing runqueue;
 };
 
 FCFS::FCFS() {
 	
 }
 
-void FCFS::add_process(Process* proc) {
+void FCFS::add_process(int proc) {
 	runqueue.push_back(proc);
 }
 
-Process* FCFS::get_next_process() {
-	if(!runqueue.empty()) {
-		Process* proc = runqueue.front();
-		runqueue.pop_front();
-		return proc;
-	}
+int FCFS::get_next_process() {
+	if(!runqueue.empty())
+		return runqueue.pop_front();
 	else
-		return NULL;
+		return -1;
+}
+
+void FCFS::checkpoint(Checkpoint &ck) {
+	runqueue.checkpoint(ck);
 }
 
 //Last Come First Served
-class LCFS : public Scheduler {
+class LCFS final : public Scheduler {
 	public:
 		LCFS();
-		void add_process(Process* proc);
-		Process* get_next_process();
+		void add_process(int proc);
+		int get_next_process();
+		void checkpoint(Checkpoint &ck);
 	private:
-		list<Process*> runqueue;
+		RunRing runqueue;
 };
 
 LCFS::LCFS() {
 	
 }
 
-void LCFS::add_process(Process* proc) {
+void LCFS::add_process(int proc) {
 	runqueue.push_back(proc);
 }
 
-Process* LCFS::get_next_process() {
-	if(!runqueue.empty()) {
-		Process* proc = runqueue.back();
-		runqueue.pop_back();
-		return proc;
-	}
+int LCFS::get_next_process() {
+	if(!runqueue.empty())
+		return runqueue.pop_back();
 	else
-		return NULL;
+		return -1;
+}
+
+void LCFS::checkpoint(Checkpoint &ck) {
+	runqueue.checkpoint(ck);
 }
 
 //Shortest Job First
-class SJF : public Scheduler {
+class SJF final : public Scheduler {
 	public:
-		SJF();
-		void add_process(Process* proc);
-		Process* get_next_process();
+		SJF(ProcessTable* procs);
+		void add_process(int proc);
+		int get_next_process();
+		void checkpoint(Checkpoint &ck);
 	private:
-		list<Process*> runqueue;
+		ProcessTable* procs;
+		RunList runqueue;
 };
 
-SJF::SJF() {
+SJF::SJF(ProcessTable* procs) : procs(procs), runqueue(procs) {
 	
 } 
 
-void SJF::add_process(Process* proc) {
-	int flag = 0;
-	list<Process*>::iterator it = runqueue.begin();
-	for(it = runqueue.begin(); it != runqueue.end(); it++) {
-		if((*it)->TC_remain > proc->TC_remain) {
-			runqueue.insert(it, proc);
-			flag = 1;
-			break;
-		}
-	}
-	//If current proc has the longest remaining time
-	if(flag == 0)
-		runqueue.push_back(proc);
+void SJF::add_process(int proc) {
+	//Before the first process with a longer remaining time, at the end if there is none
+	int pos = runqueue.head;
+	while(pos >= 0 && procs->TC_remain[pos] <= procs->TC_remain[proc])
+		pos = runqueue.next(pos);
+	runqueue.insert_before(pos, proc);
 }
 
-Process* SJF::get_next_process() {
-	if(!runqueue.empty()) {
-		Process* proc = runqueue.front();
-		runqueue.pop_front();
-		return proc;
-	}
+int SJF::get_next_process() {
+	if(!runqueue.empty())
+		return runqueue.pop_front();
 	else
-		return NULL;
+		return -1;
+}
+
+void SJF::checkpoint(Checkpoint &ck) {
+	ck.io(runqueue.head);
+	ck.io(runqueue.tail);
 }
 
 //Round Robin
-class RR : public Scheduler {
+class RR final : public Scheduler {
 	public:
 		RR(int tq);
-		void add_process(Process* proc);
-		Process* get_next_process();
+		void add_process(int proc);
+		int get_next_process();
+		void checkpoint(Checkpoint &ck);
 	private:
 		int time_quant;
-		list<Process*> runqueue;
+		RunRing runqueue;
 };
 
 RR::RR(int tq) {
 	time_quant = tq;
 }
 
-void RR::add_process(Process* proc) {
+void RR::add_process(int proc) {
 	runqueue.push_back(proc);
 }
 
-Process* RR::get_next_process() {
-	if(!runqueue.empty()) {
-		Process* proc = runqueue.front();
-		runqueue.pop_front();
-		return proc;
-	}
+int RR::get_next_process() {
+	if(!runqueue.empty())
+		return runqueue.pop_front();
 	else
-		return NULL;
+		return -1;
+}
+
+void RR::checkpoint(Checkpoint &ck) {
+	runqueue.checkpoint(ck);
 }
 
 //Priority
-class PRIO : public Scheduler {
+class PRIO final : public Scheduler {
 	public:
-		PRIO(int tq);
-		void add_process(Process* proc);
-		Process* get_next_process();
+		PRIO(int tq, ProcessTable* procs);
+		void add_process(int proc);
+		int get_next_process();
+		void checkpoint(Checkpoint &ck);
 	private:
 		int time_quant;
+		ProcessTable* procs;
 		//list<Process*> prio_queues[2][4];
-		array<list<Process*>, 4> active_queue;
-		array<list<Process*>, 4> expired_queue;
+		array<RunList, 4> active_queue;
+		array<RunList, 4> expired_queue;
 };
 
-PRIO::PRIO(int tq) {
+PRIO::PRIO(int tq, ProcessTable* procs) : procs(procs) {
 	time_quant = tq;
+	for(int i = 0; i < 4; i++) {
+		active_queue[i] = RunList(procs);
+		expired_queue[i] = RunList(procs);
+	}
 }
 
-void PRIO::add_process(Process* proc) {
+void PRIO::add_process(int proc) {
 	//When "-1" is reached the process is enqueued into the expired queue. 
-	if(proc->DPrio == -1) {
-		expired_queue[proc->SPrio - 1].push_back(proc);
+	if(procs->DPrio[proc] == -1) {
+		expired_queue[procs->SPrio[proc] - 1].push_back(proc);
 	}
 	else {	
-		active_queue[proc->DPrio].push_back(proc);
+		active_queue[procs->DPrio[proc]].push_back(proc);
 	}
 }
 
-Process* PRIO::get_next_process() {
+int PRIO::get_next_process() {
 	//When the active queue is empty, active and expired are switched.
 	bool flag = true;
 	for(int i = 0; i < 4; i++) {
@@ -245,20 +468,773 @@ Process* PRIO::get_next_process() {
 			break;
 		}
 	}
-	if(flag) {
-		auto null = active_queue;
-		active_queue = expired_queue;
-		expired_queue = null;
-	}
+	if(flag)
+		swap(active_queue, expired_queue); //Only the list heads move
 	//Is active queue empty? 
 	for(int i = 3; i >= 0; i--) {
-		if(!active_queue[i].empty()) {
-			Process* proc = active_queue[i].front();
-			active_queue[i].pop_front();
-			return proc;
+		if(!active_queue[i].empty())
+			return active_queue[i].pop_front();
+	}
+	return -1;
+}
+
+void PRIO::checkpoint(Checkpoint &ck) {
+	for(int i = 0; i < 4; i++) {
+		ck.io(active_queue[i].head);
+		ck.io(active_queue[i].tail);
+		ck.io(expired_queue[i].head);
+		ck.io(expired_queue[i].tail);
+	}
+}
+
+//Control groups, switched on with -g<file>
+//A line of the input file may end with the path of the group of the process, e.g. web/api, processes without one are
+//in the root group. The file gives "<path> <weight> [<quota> <period>]" per line, groups it does not list have weight 1
+//and no quota. Siblings share the CPU in proportion to their weights: every group, and the processes of a group taken
+//together as one more child of weight 1, has a virtual runtime that advances by the time it ran over its weight, and
+//from the root down the runnable child with the least is picked. Within a group the processes are scheduled by the -s
+//policy. A group with a quota runs at most quota time units per period, its descendants included: a burst is cut short
+//where the quota left runs out, the group is throttled at its end and an unthrottle event at the start of the next
+//period refills the quota, less any overrun.
+//The share of a group is measured only while it competes: the time its siblings ran while at least two children of
+//their parent were runnable, throttled or not, against their fair parts of it. The fair part of a child is its weight's
+//share, capped at quota over period for a child with a quota, what a cap leaves is split again among the others.
+#define CGROUP_VSCALE 1024 //virtual runtime of one time unit at weight 1
+class CGroups {
+	public:
+		vector<string> path;
+		vector<int> parent, weight, quota, period; //quota 0 for none
+		vector<long long> run_time, throttled_time; //of the group and its descendants
+		vector<long long> contended_time, share_time; //its children ran while they competed, the group itself did
+		vector<double> fair_time; //of contended_time of its parent by its weight and quota
+		vector<int> throttles;
+		vector<int> newly_throttled; //by the last charge(), each needs an unthrottle event at its period end
+		vector<int> period_end;
+		CGroups();
+		int size();
+		int find(string name); //creates the group and its ancestors if missing
+		void load(string file);
+		int cap(int g, int now); //time the groups on the path to the root may still run, INT_MAX without quota
+		void charge(int g, int now, int ran);
+		bool unthrottle(int g, int now); //false if the overrun left the group throttled for another period
+		void enqueued(int g);
+		void dequeued(int g);
+		int pick(int g); //group whose own processes run next, -1 if everything runnable below g is throttled
+		void checkpoint(Checkpoint &ck);
+	private:
+		vector<vector<int>> children;
+		vector<int> runnable, queued; //processes queued in the subtree, in the group itself
+		vector<long long> vruntime, own_vruntime, min_vruntime; //of the group, its processes, the least picked below it
+		vector<int> runtime_left;
+		vector<char> throttled;
+		vector<int> throttled_since;
+		void refill(int g, int now);
+		void share(int p, int c, int ran);
+};
+
+CGroups::CGroups() {
+	find("");
+}
+
+int CGroups::size() {
+	return path.size();
+}
+
+int CGroups::find(string name) {
+	for(int g = 0; g < size(); g++)
+		if(path[g] == name)
+			return g;
+	size_t slash = name.rfind('/');
+	int up = name.empty() ? -1 : find(slash == string::npos ? "" : name.substr(0, slash));
+	path.push_back(name);
+	parent.push_back(up);
+	for(auto field : {&weight, &period})
+		field->push_back(1);
+	for(auto field : {&quota, &throttles, &period_end, &runnable, &queued, &runtime_left, &throttled_since})
+		field->push_back(0);
+	for(auto field : {&run_time, &throttled_time, &contended_time, &share_time, &vruntime, &own_vruntime, &min_vruntime})
+		field->push_back(0);
+	fair_time.push_back(0);
+	throttled.push_back(0);
+	children.push_back(vector<int>());
+	if(up >= 0)
+		children[up].push_back(size() - 1);
+	return size() - 1;
+}
+
+void CGroups::load(string file) {
+	ifstream input(file);
+	if(!input) {
+		fprintf(stderr, "cannot open group file %s\n", file.c_str());
+		exit(1);
+	}
+	string line;
+	while(getline(input, line)) {
+		string name;
+		int w = 1, q = 0, p = 0;
+		stringstream split(line);
+		if(!(split >> name) || name[0] == '#')
+			continue;
+		split >> w >> q >> p;
+		if(name == "/")
+			name = "";
+		int g = find(name);
+		weight[g] = max(w, 1);
+		if(q > 0 && p > 0) {
+			quota[g] = q;
+			period[g] = p;
+			runtime_left[g] = q;
+			period_end[g] = p;
+		}
+	}
+}
+
+void CGroups::refill(int g, int now) {
+	if(now >= period_end[g]) {
+		runtime_left[g] = min(runtime_left[g], 0) + quota[g];
+		period_end[g] = (now / period[g] + 1) * period[g];
+	}
+}
+
+int CGroups::cap(int g, int now) {
+	int left = INT_MAX;
+	for(; g >= 0; g = parent[g]) {
+		if(quota[g] > 0) {
+			refill(g, now);
+			left = min(left, runtime_left[g]);
+		}
+	}
+	return left;
+}
+
+//Child c of p ran, -1 for the processes of p themselves
+//The quota caps the part of the parent's time, which is exact below the root and for parents that get the whole CPU
+void CGroups::share(int p, int c, int ran) {
+	vector<int> rivals; //-1 for the processes of p, they count as a child of weight 1 without quota
+	if(c < 0 || queued[p] > 0)
+		rivals.push_back(-1);
+	for(auto s : children[p])
+		if(s == c || runnable[s] > 0)
+			rivals.push_back(s);
+	if(rivals.size() < 2)
+		return;
+	contended_time[p] += ran;
+	if(c >= 0)
+		share_time[c] += ran;
+	vector<double> part(rivals.size(), -1); //fair part of the time, -1 while not capped
+	double left = 1;
+	for(bool capped = true; capped; ) {
+		capped = false;
+		double total = 0;
+		for(size_t i = 0; i < rivals.size(); i++)
+			if(part[i] < 0)
+				total += rivals[i] < 0 ? 1 : weight[rivals[i]];
+		for(size_t i = 0; i < rivals.size() && !capped; i++) {
+			int s = rivals[i];
+			if(part[i] < 0 && s >= 0 && quota[s] > 0 && left * weight[s] / total > (double)quota[s] / period[s]) {
+				part[i] = (double)quota[s] / period[s];
+				left -= part[i];
+				capped = true;
+			}
+		}
+		if(!capped)
+			for(size_t i = 0; i < rivals.size(); i++)
+				if(part[i] < 0)
+					part[i] = left * (rivals[i] < 0 ? 1 : weight[rivals[i]]) / total;
+	}
+	for(size_t i = 0; i < rivals.size(); i++)
+		if(rivals[i] >= 0)
+			fair_time[rivals[i]] += ran * part[i];
+}
+
+void CGroups::charge(int g, int now, int ran) {
+	newly_throttled.clear();
+	for(int c = -1, p = g; p >= 0; c = p, p = parent[p])
+		share(p, c, ran);
+	own_vruntime[g] += (long long)ran * CGROUP_VSCALE;
+	for(; g >= 0; g = parent[g]) {
+		vruntime[g] += (long long)ran * CGROUP_VSCALE / weight[g];
+		run_time[g] += ran;
+		if(quota[g] == 0 || throttled[g])
+			continue;
+		refill(g, now - ran); //The burst was started, and capped, in that period
+		runtime_left[g] -= ran;
+		refill(g, now); //A burst that ran into the next period leaves the group with the quota of that one
+		if(runtime_left[g] <= 0) {
+			throttled[g] = 1;
+			throttled_since[g] = now;
+			throttles[g]++;
+			period_end[g] = (now / period[g] + 1) * period[g];
+			newly_throttled.push_back(g);
+		}
+	}
+}
+
+bool CGroups::unthrottle(int g, int now) {
+	runtime_left[g] = min(runtime_left[g], 0) + quota[g];
+	period_end[g] = now + period[g];
+	if(runtime_left[g] <= 0)
+		return false;
+	throttled[g] = 0;
+	throttled_time[g] += now - throttled_since[g];
+	//Like a group that was not runnable, it does not bring back the lag it built up while throttled
+	if(parent[g] >= 0)
+		vruntime[g] = max(vruntime[g], min_vruntime[parent[g]]);
+	return true;
+}
+
+//A group or the processes of a group that become runnable start at the least virtual runtime picked among their
+//siblings, so time spent idle is not saved up to starve the others
+void CGroups::enqueued(int g) {
+	if(queued[g]++ == 0)
+		own_vruntime[g] = max(own_vruntime[g], min_vruntime[g]);
+	for(; g >= 0; g = parent[g])
+		if(runnable[g]++ == 0 && parent[g] >= 0)
+			vruntime[g] = max(vruntime[g], min_vruntime[parent[g]]);
+}
+
+void CGroups::dequeued(int g) {
+	queued[g]--;
+	for(; g >= 0; g = parent[g])
+		runnable[g]--;
+}
+
+int CGroups::pick(int g) {
+	if(throttled[g])
+		return -1;
+	vector<char> tried(children[g].size(), 0);
+	while(true) {
+		int best = -1; //index into the children, or -1 for the processes of g
+		long long least = LLONG_MAX;
+		if(queued[g] > 0)
+			least = own_vruntime[g];
+		for(int i = 0; i < (int)children[g].size(); i++) {
+			int c = children[g][i];
+			if(!tried[i] && runnable[c] > 0 && !throttled[c] && vruntime[c] < least) {
+				best = i;
+				least = vruntime[c];
+			}
+		}
+		if(least == LLONG_MAX)
+			return -1;
+		min_vruntime[g] = max(min_vruntime[g], least);
+		if(best < 0)
+			return g;
+		int picked = pick(children[g][best]);
+		if(picked >= 0)
+			return picked;
+		tried[best] = 1;
+	}
+}
+
+void CGroups::checkpoint(Checkpoint &ck) {
+	long num_groups = size();
+	ck.io(num_groups);
+	if(!ck.saving) //Numbered again in the saved order, which has the parents first
+		*this = CGroups();
+	for(long g = 0; g < num_groups; g++) {
+		vector<char> name;
+		if(ck.saving)
+			name.assign(path[g].begin(), path[g].end());
+		ck.io(name);
+		if(!ck.saving)
+			find(string(name.begin(), name.end()));
+	}
+	for(auto field : {&parent, &weight, &quota, &period, &throttles, &period_end, &runnable, &queued, &runtime_left,
+			&throttled_since})
+		ck.io(*field);
+	for(auto field : {&run_time, &throttled_time, &contended_time, &share_time, &vruntime, &own_vruntime, &min_vruntime})
+		ck.io(*field);
+	ck.io(fair_time);
+	ck.io(throttled);
+}
+
+//Scheduling within the groups: one runqueue of the policy per group, the group is picked first
+template<class Policy>
+class Grouped final : public Scheduler {
+	public:
+		Grouped(CGroups* groups, ProcessTable* procs, function<Policy*()> make);
+		void add_process(int proc);
+		int get_next_process();
+		void checkpoint(Checkpoint &ck);
+	private:
+		CGroups* groups;
+		ProcessTable* procs;
+		function<Policy*()> make;
+		vector<Policy*> local;
+};
+
+template<class Policy>
+Grouped<Policy>::Grouped(CGroups* groups, ProcessTable* procs, function<Policy*()> make) : groups(groups), procs(procs), make(make) {
+	while((int)local.size() < groups->size())
+		local.push_back(make());
+}
+
+template<class Policy>
+void Grouped<Policy>::add_process(int proc) {
+	local[procs->group[proc]]->add_process(proc);
+	groups->enqueued(procs->group[proc]);
+}
+
+template<class Policy>
+int Grouped<Policy>::get_next_process() {
+	int g = groups->pick(0);
+	if(g < 0)
+		return -1;
+	groups->dequeued(g);
+	return local[g]->get_next_process();
+}
+
+template<class Policy>
+void Grouped<Policy>::checkpoint(Checkpoint &ck) {
+	while((int)local.size() < groups->size()) //Groups only named in the input come back with the checkpoint
+		local.push_back(make());
+	for(auto queue : local)
+		queue->checkpoint(ck);
+}
+
+//Live statistics, switched on with -i<interval>
+//Kept up to date at every event in constant memory and printed every interval time units while the simulation runs.
+//A STAT line covers the window that just closed: the share of it the CPU was busy and some process was in IO, and the
+//time weighted mean and the peak of the run queue length. The percentiles of turnaround, CPU wait and response time
+//(arrival to first dispatch) cover every process finished, or dispatched, since the start.
+class RunStats {
+	public:
+		long interval;
+		Histogram TT, CW, RT;
+		RunStats(long interval);
+		void advance(long now, bool cpu_busy, bool io_busy); //the levels held since the previous event
+		void enqueued();
+		void dequeued();
+		void finish(); //print the last window if it is partial
+		void checkpoint(Checkpoint &ck);
+	private:
+		long window_start, last;
+		int runq, runq_max;
+		long long cpu_time, io_time, runq_area;
+		void integrate(long until, bool cpu_busy, bool io_busy);
+		void emit(long end);
+};
+
+RunStats::RunStats(long interval) : interval(interval) {
+	window_start = 0;
+	last = 0;
+	runq = 0;
+	runq_max = 0;
+	cpu_time = 0;
+	io_time = 0;
+	runq_area = 0;
+}
+
+void RunStats::integrate(long until, bool cpu_busy, bool io_busy) {
+	cpu_time += cpu_busy ? until - last : 0;
+	io_time += io_busy ? until - last : 0;
+	runq_area += (long long)runq * (until - last);
+	last = until;
+}
+
+void RunStats::advance(long now, bool cpu_busy, bool io_busy) {
+	while(now >= window_start + interval) {
+		integrate(window_start + interval, cpu_busy, io_busy);
+		emit(last);
+		window_start = last;
+		cpu_time = 0;
+		io_time = 0;
+		runq_area = 0;
+		runq_max = runq;
+	}
+	integrate(now, cpu_busy, io_busy);
+}
+
+void RunStats::enqueued() {
+	runq++;
+	if(runq > runq_max)
+		runq_max = runq;
+}
+
+void RunStats::dequeued() {
+	runq--;
+}
+
+void RunStats::finish() {
+	if(last > window_start)
+		emit(last);
+}
+
+void RunStats::emit(long end) {
+	double span = end - window_start;
+	printf("STAT[%ld]: CPU=%.2lf IO=%.2lf RQ=%.2lf/%d TT=%lld/%lld/%lld CW=%lld/%lld/%lld RT=%lld/%lld/%lld\n", end,
+			cpu_time / span * 100, io_time / span * 100, runq_area / span, runq_max,
+			TT.percentile(50), TT.percentile(95), TT.percentile(99), CW.percentile(50), CW.percentile(95), CW.percentile(99),
+			RT.percentile(50), RT.percentile(95), RT.percentile(99));
+	fflush(stdout); //Watched while the simulation runs
+}
+
+void RunStats::checkpoint(Checkpoint &ck) {
+	ck.io(window_start);
+	ck.io(last);
+	ck.io(runq);
+	ck.io(runq_max);
+	ck.io(cpu_time);
+	ck.io(io_time);
+	ck.io(runq_area);
+	TT.checkpoint(ck);
+	CW.checkpoint(ck);
+	RT.checkpoint(ck);
+}
+
+//I/O devices, switched on with -d
+//Without them every blocked process sleeps through its IO burst at the same time as the others. With K devices a
+//process does its IO on device pid % K, where requests wait in the queue of an IO scheduling policy from iosched.h and
+//are served one at a time. A request transfers for the IO burst plus, with a disk model (-m), the time to position the
+//head from where it is to the track of the process. The process is BLOCKED from submission until the transfer is done.
+//Every process is a tenant of its device weighted by its static priority, which BFQ (-db) shares the device by. While
+//a policy holds the free device for the next request of the tenant it served last, the device looks again every tick
+//and requests of other processes keep arriving in the meantime.
+#define IO_TRACKS 200 //tracks of a device, the processes of a device have their data spread over them
+struct BurstIO : public iosched::IOrequest {
+	int proc, burst;
+	BurstIO(int id, int now, int track, int proc, int burst);
+};
+
+BurstIO::BurstIO(int id, int now, int track, int proc, int burst) : iosched::IOrequest(id, now, track) {
+	this->proc = proc;
+	this->burst = burst;
+}
+
+class IODevice {
+	public:
+		BurstIO* active;
+		bool idle_event; //a TRANS_TO_IO_IDLE event is pending
+		long served;
+		long long busy, wait;
+		int max_wait;
+		IODevice(iosched::IOScheduler* queue, iosched::DiskModel* disk);
+		BurstIO* submit(BurstIO* io, int now); //the request started, NULL if none
+		BurstIO* complete(int now); //the next request started, NULL if none
+		BurstIO* dispatch(int now); //the request started on the free device, NULL if none
+		bool idling();
+		void checkpoint(Checkpoint &ck, Index<BurstIO> &ios);
+	private:
+		int head;
+		iosched::IOScheduler* queue;
+		iosched::DiskModel* disk; //NULL for the transfer only
+		void start(BurstIO* io, int now);
+};
+
+IODevice::IODevice(iosched::IOScheduler* queue, iosched::DiskModel* disk) : queue(queue), disk(disk) {
+	active = NULL;
+	idle_event = false;
+	served = 0;
+	busy = 0;
+	wait = 0;
+	max_wait = 0;
+	head = 0;
+}
+
+void IODevice::start(BurstIO* io, int now) {
+	int service = io->burst + (disk != NULL ? disk->service_time(head, io, now) : 0);
+	io->start_time = now;
+	io->end_time = now + service;
+	head = io->track;
+	active = io;
+	served++;
+	busy += service;
+	wait += now - io->arrival_time;
+	if(now - io->arrival_time > max_wait)
+		max_wait = now - io->arrival_time;
+}
+
+BurstIO* IODevice::submit(BurstIO* io, int now) {
+	queue->addIOrequest(io);
+	return active == NULL ? dispatch(now) : NULL;
+}
+
+BurstIO* IODevice::complete(int now) {
+	active = NULL;
+	return dispatch(now);
+}
+
+BurstIO* IODevice::dispatch(int now) {
+	queue->cur_time = now;
+	BurstIO* next = (BurstIO*)queue->getIOrequest(head);
+	if(next != NULL)
+		start(next, now);
+	return next;
+}
+
+//Free, with requests queued, but held for the next request of the tenant served last
+bool IODevice::idling() {
+	return active == NULL && queue->idling();
+}
+
+void IODevice::checkpoint(Checkpoint &ck, Index<BurstIO> &ios) {
+	ck.io(head);
+	ck.io(served);
+	ck.io(busy);
+	ck.io(wait);
+	ck.io(max_wait);
+	ck.io(idle_event);
+	ck.ref(active, ios);
+	Index<iosched::IOrequest> reqs;
+	reqs.id_of = [](iosched::IOrequest* r) { return (long)r->index; };
+	reqs.at = [&](long id) { return (iosched::IOrequest*)ios.at(id); };
+	ck.io(queue->cur_time);
+	queue->checkpoint(ck, reqs);
+}
+
+//Energy and frequency model, switched on with -e<governor>
+//Each burst runs at the P-state the governor picks when it is dispatched, w time units of work at full speed take
+//w * 100 / freq time units. An idle CPU sleeps in the deepest C-state whose target residency fits the idle time
+//predicted from the previous idle period. Getting there takes the entry latency of the C-state, spent at the power of
+//C1, and a burst dispatched to a sleeping CPU starts after what is left of the entry and the exit latency.
+//Times are ms and powers mW, so energies are uJ.
+//Governors: p=performance (top frequency) s=powersave (lowest frequency) o=ondemand (load of the last sampling period)
+//u=schedutil (1.25 times the utilization of the runqueue, decayed as PELT does)
+struct PState { int freq, power; }; //percent of the top frequency, mW while running
+struct CState { const char* name; int entry_latency, exit_latency, residency, power; }; //ms to enter and to wake up, least idle ms worth entering, mW
+#define NUM_PSTATES 4
+#define NUM_CSTATES 3
+const PState pstates[NUM_PSTATES] = {{100, 1500}, {80, 1020}, {60, 640}, {40, 350}};
+const CState cstates[NUM_CSTATES] = {{"C1", 0, 0, 0, 250}, {"C3", 1, 1, 4, 80}, {"C6", 2, 2, 20, 10}};
+#define ONDEMAND_PERIOD 50 //ms between two load samples
+#define ONDEMAND_UP 80 //load in percent that asks for the top frequency
+#define PELT_HALFLIFE 32.0 //ms for the utilization to decay by half
+
+class CPUPower {
+	public:
+		int work; //of the burst running, at full speed
+		long long burst_energy; //of the burst running
+		long long active_energy, idle_energy, wake_energy;
+		array<long long, NUM_PSTATES> p_time;
+		array<long long, NUM_CSTATES> c_time;
+		CPUPower(char governor);
+		int dispatch(int now, int work); //time the burst takes, wake-up included
+		void idle(int now);
+		void add(CPUPower &cpu);
+		void checkpoint(Checkpoint &ck);
+	private:
+		char governor;
+		int pstate, cstate;
+		int idle_since, predicted_idle, busy_since;
+		int sample_start, ondemand_freq;
+		long long sample_busy;
+		double util;
+		void choose_pstate(int now);
+};
+
+CPUPower::CPUPower(char governor) : governor(governor) {
+	work = 0;
+	burst_energy = 0;
+	active_energy = 0;
+	idle_energy = 0;
+	wake_energy = 0;
+	p_time.fill(0);
+	c_time.fill(0);
+	pstate = 0;
+	cstate = 0;
+	idle_since = 0;
+	predicted_idle = 0;
+	busy_since = 0;
+	sample_start = 0;
+	ondemand_freq = 100;
+	sample_busy = 0;
+	util = 0;
+}
+
+void CPUPower::choose_pstate(int now) {
+	int want = 100;
+	if(governor == 's')
+		want = 0;
+	else if(governor == 'o') {
+		if(now - sample_start >= ONDEMAND_PERIOD) {
+			int load = (int)min(sample_busy * 100 / (now - sample_start), 100LL);
+			ondemand_freq = load >= ONDEMAND_UP ? 100 : load * 100 / ONDEMAND_UP;
+			sample_start = now;
+			sample_busy = 0;
+		}
+		want = ondemand_freq;
+	}
+	else if(governor == 'u')
+		want = (int)(125 * util);
+	pstate = 0;
+	for(int p = NUM_PSTATES - 1; p >= 0; p--) {
+		if(pstates[p].freq >= want) {
+			pstate = p;
+			break;
+		}
+	}
+}
+
+int CPUPower::dispatch(int now, int work) {
+	int gap = now - idle_since, wake = 0;
+	int entering = min(gap, cstates[cstate].entry_latency);
+	idle_energy += (long long)cstates[0].power * entering + (long long)cstates[cstate].power * (gap - entering);
+	c_time[0] += entering;
+	c_time[cstate] += gap - entering;
+	if(gap > 0) { //Back to back bursts never left C0
+		wake = cstates[cstate].entry_latency - entering + cstates[cstate].exit_latency;
+		predicted_idle = gap;
+	}
+	util *= pow(0.5, gap / PELT_HALFLIFE);
+	choose_pstate(now);
+	int wall = (work * 100 + pstates[pstate].freq - 1) / pstates[pstate].freq;
+	this->work = work;
+	burst_energy = (long long)pstates[pstate].power * wall;
+	active_energy += burst_energy;
+	wake_energy += (long long)pstates[pstate].power * wake;
+	p_time[pstate] += wall + wake;
+	sample_busy += wall + wake;
+	busy_since = now;
+	return wake + wall;
+}
+
+void CPUPower::idle(int now) {
+	double decay = pow(0.5, (now - busy_since) / PELT_HALFLIFE);
+	util = util * decay + (1 - decay);
+	idle_since = now;
+	cstate = 0;
+	for(int c = NUM_CSTATES - 1; c > 0; c--) {
+		if(cstates[c].residency <= predicted_idle) {
+			cstate = c;
+			break;
+		}
+	}
+}
+
+void CPUPower::add(CPUPower &cpu) {
+	active_energy += cpu.active_energy;
+	idle_energy += cpu.idle_energy;
+	wake_energy += cpu.wake_energy;
+	for(int p = 0; p < NUM_PSTATES; p++)
+		p_time[p] += cpu.p_time[p];
+	for(int c = 0; c < NUM_CSTATES; c++)
+		c_time[c] += cpu.c_time[c];
+}
+
+void CPUPower::checkpoint(Checkpoint &ck) {
+	ck.io(work);
+	ck.io(burst_energy);
+	ck.io(active_energy);
+	ck.io(idle_energy);
+	ck.io(wake_energy);
+	ck.io(p_time);
+	ck.io(c_time);
+	ck.io(pstate);
+	ck.io(cstate);
+	ck.io(idle_since);
+	ck.io(predicted_idle);
+	ck.io(busy_since);
+	ck.io(sample_start);
+	ck.io(ondemand_freq);
+	ck.io(sample_busy);
+	ck.io(util);
+}
+
+//Replay on the host, switched on with -x<us>[:<policy>[:<cpu>]]
+//After the simulation every process of the input file becomes a thread that sleeps until its arrival, then spins
+//for each CPU burst and sleeps for each IO burst the simulation drew for it, so both see the same myrandom stream. A
+//time unit lasts us microseconds. A CPU burst is over when the thread has been given that much CPU time, the time
+//it was runnable but not running is its CPU wait. The threads run under SCHED_OTHER (o), SCHED_FIFO (f) or SCHED_RR
+//(r), with the static priority as real time priority for PRIO, and are pinned to the CPU given, CPU 0 by default,
+//-1 for none. The measured FT, TT and CW are printed beside the simulated ones.
+class Replay {
+	public:
+		vector<vector<int>> bursts; //CPU and IO bursts of each process, alternating, drawn by the simulation
+		Replay(string spec);
+		void run(ProcessTable &procs, char alg);
+	private:
+		int unit, cpu;
+		char policy;
+		void process(ProcessTable &procs, char alg, int proc, chrono::steady_clock::time_point epoch, vector<double> &measured);
+		void setup(int prio);
+};
+
+Replay::Replay(string spec) {
+	unit = 1000;
+	policy = 'o';
+	cpu = 0;
+	sscanf(spec.c_str(), "%d:%c:%d", &unit, &policy, &cpu);
+	unit = max(unit, 1);
+	if(string("ofr").find(policy) == string::npos) {
+		fprintf(stderr, "Unknown replay policy '%c', use -x<us>[:[ o | f | r ][:<cpu>]]\n", policy);
+		exit(1);
+	}
+}
+
+//Pinning and the policy are best effort, the replay goes on without them
+void Replay::setup(int prio) {
+#ifdef __linux__
+	if(cpu >= 0) {
+		cpu_set_t set;
+		CPU_ZERO(&set);
+		CPU_SET(cpu, &set);
+		if(pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0)
+			fprintf(stderr, "replay: cannot pin to CPU %d\n", cpu);
+	}
+#endif
+	if(policy != 'o') {
+		sched_param param;
+		param.sched_priority = prio;
+		if(pthread_setschedparam(pthread_self(), policy == 'f' ? SCHED_FIFO : SCHED_RR, &param) != 0)
+			fprintf(stderr, "replay: cannot use SCHED_%s, running under SCHED_OTHER\n", policy == 'f' ? "FIFO" : "RR");
+	}
+}
+
+//Microseconds of CPU time the calling thread has had
+double thread_cpu_us() {
+	timespec ts;
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+	return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+void Replay::process(ProcessTable &procs, char alg, int proc, chrono::steady_clock::time_point epoch, vector<double> &measured) {
+	typedef chrono::steady_clock clock;
+	setup(alg == 'P' ? procs.SPrio[proc] : 1);
+	this_thread::sleep_until(epoch + chrono::microseconds((long long)procs.AT[proc] * unit));
+	double wait = 0;
+	for(int i = 0; i < (int)bursts[proc].size(); i++) {
+		if(i % 2 == 1) { //IO
+			this_thread::sleep_for(chrono::microseconds((long long)bursts[proc][i] * unit));
+			continue;
 		}
+		clock::time_point start = clock::now();
+		double cpu_start = thread_cpu_us(), target = (double)bursts[proc][i] * unit;
+		while(thread_cpu_us() - cpu_start < target)
+			;
+		double wall = chrono::duration<double, micro>(clock::now() - start).count();
+		wait += max(wall - (thread_cpu_us() - cpu_start), 0.0);
+	}
+	measured[2 * proc] = chrono::duration<double, micro>(clock::now() - epoch).count() / unit;
+	measured[2 * proc + 1] = wait / unit;
+}
+
+void Replay::run(ProcessTable &procs, char alg) {
+	printf("REPLAY %dus %s CPU %d\n", unit, policy == 'f' ? "SCHED_FIFO" : policy == 'r' ? "SCHED_RR" : "SCHED_OTHER", cpu);
+	fflush(stdout);
+	vector<double> measured(2 * procs.size()); //FT and CW of each process
+	chrono::steady_clock::time_point epoch = chrono::steady_clock::now() + chrono::milliseconds(100); //All threads are up by then
+	vector<thread> threads;
+	for(int proc = 0; proc < procs.size(); proc++)
+		threads.push_back(thread([&, proc]() { process(procs, alg, proc, epoch, measured); }));
+	for(auto &t : threads)
+		t.join();
+	//Measured FT, TT and CW | simulated FT, TT and CW, then the means and the mean relative error of TT
+	double ft = 0, sim_ft = 0, tt = 0, sim_tt = 0, cw = 0, sim_cw = 0, err = 0;
+	for(int proc = 0; proc < procs.size(); proc++) {
+		double m_ft = measured[2 * proc], m_tt = m_ft - procs.AT[proc], m_cw = measured[2 * proc + 1];
+		printf("%04d: %7.0lf %7.0lf %7.0lf | %5d %5d %5d\n", procs.pid[proc], m_ft, m_tt, m_cw, procs.FT[proc], procs.TT[proc],
+				procs.CW[proc]);
+		ft = max(ft, m_ft);
+		sim_ft = max(sim_ft, (double)procs.FT[proc]);
+		tt += m_tt;
+		sim_tt += procs.TT[proc];
+		cw += m_cw;
+		sim_cw += procs.CW[proc];
+		err += procs.TT[proc] > 0 ? fabs(m_tt - procs.TT[proc]) / procs.TT[proc] : 0;
 	}
-	return NULL;
+	int n = max(procs.size(), 1);
+	printf("REPLAY-SUM: %.0lf %.0lf %.2lf %.2lf %.2lf %.2lf %.2lf\n", ft, sim_ft, tt / n, sim_tt / n, cw / n, sim_cw / n, err / n * 100);
 }
 
 //Discrete Event Simulation
@@ -266,22 +1242,66 @@ class DES {
 	public:
 		DES();
 		void Simulation(string infile, string rfile, string scheAlg, int time_quant, bool vout);
+		void Sweep(string infile, string rfile, vector<string> algs, vector<int> quanta);
+		template<class Sched>
+		void run(Sched* sche, int time_quant);
+		void schedule(int time_quant);
+		void run_partitioned(int time_quant);
+		template<class Sched>
+		void snapshot(Checkpoint &ck, Sched* sche, int &io_start, int &io_num, bool &call_scheduler, int &running);
 		void readInputFile(string infile);
 		void readRandomFile(string rfile);
+		string workload_spec; //generate the processes instead of reading them
+		string trace_file; //Chrome trace of the process states
+		string checkpoint_file, restore_file;
+		long checkpoint_every; //events between two checkpoints, 0 for none
+		int cpus, threads; //partitioned mode when cpus > 1
+		long stats_interval; //time units between two STAT lines, 0 for none
+		string io_alg, io_model; //IO scheduler and disk model of the devices, no devices without io_alg
+		int io_devices;
+		char governor; //of the energy model, 0 for none
+		string group_file; //control groups, none without it
+		string replay_spec; //replay on the host afterwards, none without it
 		
 	private:
-		int rcount, rofs, pid, FINISH_TIME, totalTC, totalIT, totalCW, totalTT;
+		int rcount, rofs, pid, FINISH_TIME;
+		char alg;
+		long events_done;
+		long num_finished;
+		long long totalTC, totalIT, totalCW, totalTT;
 		double CPU_UTIL, IO_UTIL, AVG_TT, AVG_CW, THROUGHPUT;
-		Scheduler* sche; 
 		vector<int> randvals;
-		list<Process*> proc_list;
+		ProcessTable* table;
 		list<Event*> event_list;
+		vector<list<Event*>> arrivals; //partitioned mode, the arrivals read from the input file per CPU
+		Workload* workload;
+		int max_TC, max_CB, max_IO;
+		
+		void start_workload(string spec);
+		void generate();
+		void retire(int proc);
+		ChromeTrace* tracer;
+		RunStats* stats;
+		vector<IODevice*> devices;
+		CPUPower* power;
+		CGroups* groups;
+		Replay* replay;
+		map<int, BurstIO*> inflight; //requests queued or being served by id
+		int io_id;
+		void open_devices();
+		void submit_io(int proc, int now, int burst);
+		void complete_io(int proc, int now);
+		void started_io(int k, BurstIO* io, int now);
+		void trace_state(int proc, int now, const char* cause);
 		
 		Event* get_event();
 		void put_event(Event* event);
+		void insert_event(list<Event*> &events, Event* event);
 		void delete_event();
 		int get_next_event_time();
 		void printSummary();
+		void summarize();
+		double energy(); //uJ
 		void printv(bool verbose, Event* evt, int curr_time, int io_burst);
 		int myrandom(int burst);
 };
@@ -291,6 +1311,7 @@ DES::DES() {
 	rofs = 0;
 	pid = 0;
 	FINISH_TIME = 0;
+	num_finished = 0;
 	totalTC = 0;
 	totalIT = 0;
 	totalCW = 0;
@@ -300,6 +1321,28 @@ DES::DES() {
 	AVG_TT = 0;
 	AVG_CW = 0;
 	THROUGHPUT = 0;
+	workload = NULL;
+	table = new ProcessTable();
+	tracer = NULL;
+	stats = NULL;
+	stats_interval = 0;
+	io_devices = 1;
+	io_id = 0;
+	governor = 0;
+	power = NULL;
+	groups = NULL;
+	replay = NULL;
+	checkpoint_every = 0;
+	events_done = 0;
+	cpus = 1;
+	threads = 1;
+}
+
+//The state the process leaves, from state_ts to now, on the lane of its pid
+void DES::trace_state(int proc, int now, const char* cause) {
+	ProcessTable &procs = *table;
+	if(now > procs.state_ts[proc] && procs.state[proc] != STATE_CREATED && procs.state[proc] != STATE_FINISHED)
+		tracer->record(procs.state_ts[proc], now - procs.state_ts[proc], procs.pid[proc], state_names[procs.state[proc]], cause);
 }
 
 Event* DES::get_event() {
@@ -310,18 +1353,23 @@ Event* DES::get_event() {
 }
 
 void DES::put_event(Event* event) {
-	int flag = 0;
-	list<Event*>::iterator it = event_list.begin();
-	for(it = event_list.begin(); it != event_list.end(); it++) {
+	insert_event(event_list, event);
+}
+
+//Behind the events of the same time, an event later than all of them is appended at once: the input file is in
+//arrival order, so reading it stays linear
+void DES::insert_event(list<Event*> &events, Event* event) {
+	if(events.empty() || events.back()->time_stamp <= event->time_stamp) {
+		events.push_back(event);
+		return;
+	}
+	list<Event*>::iterator it = events.begin();
+	for(it = events.begin(); it != events.end(); it++) {
 		if((*it)->time_stamp > event->time_stamp) { //find the first event timestamp in the list bigger than that of arriving event
-			event_list.insert(it, event); //insert to the proper position
-			flag = 1;
+			events.insert(it, event); //insert to the proper position
 			break;
 		}
 	}
-	if(flag == 0) {//timestamp bigger than all the events
-		event_list.push_back(event);
-	}
 }
 
 void DES::delete_event() {
@@ -344,20 +1392,76 @@ void DES::readInputFile(string infile) {
 	ifstream input;
 	input.open(infile);
 	string line;
+	if(cpus > 1) //Every CPU gets its arrivals as they are read
+		arrivals.assign(cpus, list<Event*>());
 	while(getline(input, line)) {
 		int at, tc, cb, io, prio;
 		stringstream split(line);
 		split >> at >> tc >> cb >> io; 
 		prio = myrandom(4);
-		Process *proc = new Process(pid, STATE_CREATED, at, tc, cb, io, prio);
-		proc_list.push_back(proc);
+		int proc = table->add(pid, STATE_CREATED, at, tc, cb, io, prio);
+		string group;
+		if(groups != NULL && split >> group)
+			table->group[proc] = groups->find(group);
 		Event *event = new Event(proc, at, TRANS_TO_READY); //from CREATED(1)
-		put_event(event);
+		insert_event(cpus > 1 ? arrivals[pid % cpus] : event_list, event);
 		pid++;
 	}
 	input.close();
 }
 
+void DES::start_workload(string spec) {
+	workload = new Workload(spec);
+	max_TC = max((int)workload->get("tc", 1000.0), 1);
+	max_CB = max((int)workload->get("cb", 20.0), 1);
+	max_IO = max((int)workload->get("io", 20.0), 1);
+	do
+		generate();
+	while(workload->closed && workload->client_pending() && workload->generated < workload->count);
+}
+
+//Generated processes arrive one at a time: an open loop arrival schedules the next one when it is admitted,
+//a closed loop client issues its next process a think time after the previous one finished.
+//The CPU burst limit follows the workload distribution (a zipf skew gives many short and few long bursts),
+//total CPU time and I/O burst limit are uniform. The tc, cb and io keys bound the three.
+void DES::generate() {
+	long at;
+	int client = -1;
+	if(workload->generated >= workload->count)
+		return;
+	if(workload->closed) {
+		pair<long, int> next = workload->next_client();
+		at = next.first;
+		client = next.second;
+	}
+	else
+		at = workload->next_arrival();
+	int tc = workload->uniform(1, max_TC);
+	int cb = 1 + workload->sample(max_CB, 1);
+	int io = workload->uniform(1, max_IO);
+	int proc = table->add(pid, STATE_CREATED, at, tc, cb, io, myrandom(4));
+	table->client[proc] = client;
+	put_event(new Event(proc, at, TRANS_TO_READY));
+	pid++;
+}
+
+//Generated processes are accounted for and their slot freed when they finish
+void DES::retire(int proc) {
+	if(workload == NULL)
+		return;
+	ProcessTable &procs = *table;
+	if(procs.FT[proc] > FINISH_TIME)	FINISH_TIME = procs.FT[proc];
+	totalTC += procs.TC[proc];
+	totalCW += procs.CW[proc];
+	totalTT += procs.TT[proc];
+	num_finished++;
+	if(workload->closed)
+		workload->client_ready(procs.client[proc], procs.FT[proc]);
+	table->release(proc);
+	if(workload->closed)
+		generate();
+}
+
 //Generate random numbers
 void DES::readRandomFile(string rfile) {
 	ifstream input;
@@ -377,103 +1481,424 @@ int DES::myrandom(int burst)  {
 	return rand;
 }
 
+//Runs body(0) .. body(n - 1) on up to threads threads, each thread takes the next index when it is done
+void parallel_for(int n, int threads, function<void(int)> body) {
+	atomic<int> next(0);
+	vector<thread> pool;
+	for(int t = 0; t < min(threads, n); t++)
+		pool.push_back(thread([&]() {
+			for(int i = next++; i < n; i = next++)
+				body(i);
+		}));
+	for(auto &worker : pool)
+		worker.join();
+}
+
 //Simulation
 void DES::Simulation(string infile, string rfile, string scheAlg, int time_quant, bool vout) {
 	readRandomFile(rfile);
-	readInputFile(infile);
-	char alg = scheAlg[0];
-	if(alg == 'F') {
-		sche = new FCFS();
-		cout<<"FCFS"<<endl;
+	if(!workload_spec.empty() && (checkpoint_every > 0 || !restore_file.empty())) {
+		fprintf(stderr, "checkpoints replay an input file, they do not cover generated workloads\n");
+		exit(1);
 	}
-	if(alg == 'L') {
-		sche = new LCFS();
-		cout<<"LCFS"<<endl;
+	if(cpus > 1 && (checkpoint_every > 0 || !restore_file.empty() || !trace_file.empty() || stats_interval > 0)) {
+		fprintf(stderr, "checkpoints, traces and live statistics do not cover the partitioned mode\n");
+		exit(1);
 	}
-	if(alg == 'S') {
-		sche = new SJF();
-		cout<<"SJF"<<endl;
+	if(governor != 0 && string("psou").find(governor) == string::npos) {
+		fprintf(stderr, "Unknown governor '%c', use -e[ p | s | o | u ]\n", governor);
+		exit(1);
 	}
-	if(alg == 'R') {
-		sche = new RR(time_quant);
-		cout<<"RR "<<time_quant<<endl;
+	if(cpus > 1 && !io_alg.empty()) {
+		fprintf(stderr, "the CPUs of the partitioned mode share no devices\n");
+		exit(1);
 	}
-	if(alg == 'P') {
-		sche = new PRIO(time_quant);
-		cout<<"PRIO "<<time_quant<<endl;
+	if(!replay_spec.empty()) {
+		if(cpus > 1 || !workload_spec.empty() || !restore_file.empty() || !io_alg.empty() || governor != 0 || !group_file.empty()) {
+			fprintf(stderr, "a replay runs the processes of an input file on one CPU, without devices, energy model or groups\n");
+			exit(1);
+		}
+		replay = new Replay(replay_spec);
 	}
-	
+	if(!group_file.empty()) {
+		if(cpus > 1 || !workload_spec.empty()) {
+			fprintf(stderr, "control groups apply to the processes of an input file on one CPU\n");
+			exit(1);
+		}
+		groups = new CGroups();
+		groups->load(group_file);
+	}
+	if(!workload_spec.empty()) {
+		if(cpus == 1) //Otherwise every CPU generates its own share
+			start_workload(workload_spec);
+	}
+	else if(restore_file.empty()) //Otherwise the processes come from the checkpoint
+		readInputFile(infile);
+	if(replay != NULL)
+		replay->bursts.resize(table->size());
+	if(!trace_file.empty()) {
+#ifdef DES_TRACE
+		tracer = new ChromeTrace(trace_file.c_str(), "pid");
+#else
+		fprintf(stderr, "tracing is not compiled in, rebuild with -DDES_TRACE\n");
+#endif
+	}
+	if(stats_interval > 0)
+		stats = new RunStats(stats_interval);
+	alg = scheAlg.empty() ? 0 : scheAlg[0];
+	switch(alg) {
+		case 'F':
+			cout<<"FCFS"<<endl;
+			break;
+		case 'L':
+			cout<<"LCFS"<<endl;
+			break;
+		case 'S':
+			cout<<"SJF"<<endl;
+			break;
+		case 'R':
+			cout<<"RR "<<time_quant<<endl;
+			break;
+		case 'P':
+			cout<<"PRIO "<<time_quant<<endl;
+			break;
+		default:
+			fprintf(stderr, "Unknown scheduler '%s', use -s[ FLS | R<num> | P<num> ]\n", scheAlg.c_str());
+			exit(1);
+	}
+	if(cpus > 1)
+		run_partitioned(time_quant);
+	else
+		schedule(time_quant);
+	if(tracer != NULL)
+		tracer->close();
+	if(stats != NULL)
+		stats->finish();
+	printSummary();
+	if(replay != NULL)
+		replay->run(*table, alg);
+}
+
+//One dispatch on the algorithm, the event loop is instantiated per scheduler so its calls bind statically
+void DES::schedule(int time_quant) {
+	if(!io_alg.empty())
+		open_devices();
+	if(governor != 0)
+		power = new CPUPower(governor);
+	auto start = [&](auto make) {
+		typedef typename remove_pointer<decltype(make())>::type Policy;
+		if(groups != NULL)
+			run(new Grouped<Policy>(groups, table, make), time_quant);
+		else
+			run(make(), time_quant);
+	};
+	switch(alg) {
+		case 'F':
+			start([]() { return new FCFS(); });
+			break;
+		case 'L':
+			start([]() { return new LCFS(); });
+			break;
+		case 'S':
+			start([&]() { return new SJF(table); });
+			break;
+		case 'R':
+			start([&]() { return new RR(time_quant); });
+			break;
+		case 'P':
+			start([&]() { return new PRIO(time_quant, table); });
+			break;
+	}
+}
+
+void DES::open_devices() {
+	iosched::DiskModel* disk = NULL;
+	if(!io_model.empty() && (disk = iosched::newDiskModel(io_model[0])) == NULL) {
+		fprintf(stderr, "Unknown disk model '%s', use -m[ l | c | r | s ]\n", io_model.c_str());
+		exit(1);
+	}
+	for(int k = 0; k < io_devices; k++) {
+		iosched::IOScheduler* queue = iosched::newIOScheduler(io_alg[0], disk);
+		if(queue == NULL) {
+			fprintf(stderr, "Unknown IO scheduler '%s', use -d[ i | j | s | c | f | a | d | b ][:<devices>]\n", io_alg.c_str());
+			exit(1);
+		}
+		devices.push_back(new IODevice(queue, disk));
+	}
+}
+
+void DES::submit_io(int proc, int now, int burst) {
+	ProcessTable &procs = *table;
+	int K = devices.size();
+	BurstIO* io = new BurstIO(io_id++, now, procs.pid[proc] / K % IO_TRACKS, proc, burst);
+	io->tenant = procs.pid[proc];
+	io->weight = procs.SPrio[proc];
+	inflight[io->index] = io;
+	int k = procs.pid[proc] % K;
+	started_io(k, devices[k]->submit(io, now), now);
+}
+
+void DES::complete_io(int proc, int now) {
+	int k = table->pid[proc] % devices.size();
+	IODevice* dev = devices[k];
+	inflight.erase(dev->active->index);
+	delete dev->active;
+	started_io(k, dev->complete(now), now);
+}
+
+//Schedules the end of the request device k started, or its next look while it idles
+void DES::started_io(int k, BurstIO* io, int now) {
+	if(io != NULL)
+		put_event(new Event(io->proc, io->end_time, TRANS_TO_BLOCK));
+	else if(devices[k]->idling() && !devices[k]->idle_event) {
+		devices[k]->idle_event = true;
+		put_event(new Event(k, now + 1, TRANS_TO_IO_IDLE));
+	}
+}
+
+//Partitioned mode
+//Every CPU has its own runqueue and a process is pinned to CPU pid % cpus. The CPUs share no state and send each
+//other no events, so each one is a logical process with its own event list that can be simulated to its end without
+//waiting for the others: the threads only meet at the join. CPU k reads the rfile from its own offset, k * rcount / cpus
+//further on, and with a generated workload it sees the arrival process of the spec for its share of the n processes,
+//drawn from the seed plus k. The result depends on the number of CPUs, never on the number of threads or their timing.
+void DES::run_partitioned(int time_quant) {
+	vector<DES*> lps;
+	for(int k = 0; k < cpus; k++) {
+		DES* lp = new DES();
+		lp->alg = alg;
+		lp->rcount = rcount;
+		lp->randvals = randvals;
+		lp->rofs = rofs + k * (rcount / cpus);
+		lp->governor = governor;
+		lps.push_back(lp);
+	}
+	if(!workload_spec.empty()) {
+		Workload spec(workload_spec);
+		for(int k = 0; k < cpus; k++) {
+			stringstream share;
+			share << workload_spec << ",n=" << spec.count / cpus + (k < spec.count % cpus) << ",seed=" << (long)spec.get("seed", 1.0) + k;
+			lps[k]->start_workload(share.str());
+		}
+	}
+	//Every CPU copies the processes read from the input file into a table of its own, so the threads do not write to
+	//the same cache lines, and hands back their figures when it is done
+	parallel_for(cpus, threads, [&](int k) {
+		ProcessTable &procs = *table, &own = *lps[k]->table;
+		vector<int> slots; //slot in the shared table of each slot of the CPU
+		if(k < (int)arrivals.size()) {
+			for(auto evt : arrivals[k]) {
+				slots.push_back(evt->proc);
+				evt->proc = own.add(procs.pid[evt->proc], STATE_CREATED, procs.AT[evt->proc], procs.TC[evt->proc], procs.CB[evt->proc],
+						procs.IO[evt->proc], procs.SPrio[evt->proc]);
+			}
+			lps[k]->event_list.swap(arrivals[k]);
+		}
+		lps[k]->schedule(time_quant);
+		for(int slot = 0; slot < (int)slots.size(); slot++) {
+			int proc = slots[slot];
+			procs.state[proc] = own.state[slot];
+			procs.FT[proc] = own.FT[slot];
+			procs.TT[proc] = own.TT[slot];
+			procs.IT[proc] = own.IT[slot];
+			procs.CW[proc] = own.CW[slot];
+			procs.energy[proc] = own.energy[slot];
+		}
+	});
+	//Generated processes were accounted for by their CPU, read ones are summed up from the table
+	if(governor != 0)
+		power = new CPUPower(governor);
+	for(auto lp : lps) {
+		if(power != NULL)
+			power->add(*lp->power);
+		FINISH_TIME = max(FINISH_TIME, lp->FINISH_TIME);
+		totalTC += lp->totalTC;
+		totalCW += lp->totalCW;
+		totalTT += lp->totalTT;
+		totalIT += lp->totalIT;
+		num_finished += lp->num_finished;
+		delete lp->table;
+		delete lp;
+	}
+}
+
+//Sweep mode
+//The input file and the rfile are read once, so every configuration sees the same processes with the same priorities.
+//Each configuration runs on its own copy of the processes with its own random cursor, starting where the load left it,
+//and one row with the figures of the SUM line is printed per configuration in the order given.
+void DES::Sweep(string infile, string rfile, vector<string> algs, vector<int> quanta) {
+	readRandomFile(rfile);
+	if(!group_file.empty()) {
+		groups = new CGroups();
+		groups->load(group_file);
+	}
+	readInputFile(infile);
+	vector<DES*> runs;
+	if(governor != 0 && string("psou").find(governor) == string::npos) {
+		fprintf(stderr, "Unknown governor '%c', use -e[ p | s | o | u ]\n", governor);
+		exit(1);
+	}
+	for(int i = 0; i < (int)algs.size(); i++) {
+		if(algs[i].empty() || string("FLSRP").find(algs[i][0]) == string::npos) {
+			fprintf(stderr, "Unknown scheduler '%s', use -S<list of FLS | R<num> | P<num>>\n", algs[i].c_str());
+			exit(1);
+		}
+		DES* run = new DES();
+		run->alg = algs[i][0];
+		run->rcount = rcount;
+		run->randvals = randvals;
+		run->rofs = rofs;
+		run->pid = pid;
+		run->io_alg = io_alg;
+		run->io_model = io_model;
+		run->io_devices = io_devices;
+		run->governor = governor;
+		if(groups != NULL)
+			run->groups = new CGroups(*groups);
+		runs.push_back(run);
+	}
+	parallel_for(runs.size(), threads, [&](int i) {
+		DES* run = runs[i];
+		*run->table = *table;
+		for(auto evt : event_list)
+			run->event_list.push_back(new Event(evt->proc, evt->time_stamp, evt->transition));
+		run->schedule(quanta[i]);
+		run->summarize();
+		delete run->table;
+		run->table = NULL;
+	});
+	for(int i = 0; i < (int)runs.size(); i++) {
+		DES* run = runs[i];
+		string name = algs[i][0] == 'R' || algs[i][0] == 'P' ? algs[i].substr(0, 1) + to_string(quanta[i]) : algs[i].substr(0, 1);
+		printf("SWEEP[%s]: %d %.2lf %.2lf %.2lf %.2lf %.3lf", name.c_str(), run->FINISH_TIME, run->CPU_UTIL, run->IO_UTIL,
+				run->AVG_TT, run->AVG_CW, run->THROUGHPUT);
+		if(run->power != NULL) //Energy in mJ and processes finished per J
+			printf(" %.2lf %.3lf", run->energy() / 1000, run->num_finished / (run->energy() / 1e6));
+		printf("\n");
+		delete run;
+	}
+}
+
+//Event loop of one scheduler
+template<class Sched>
+void DES::run(Sched* sche, int time_quant) {
 	Event* evt;
 	int IO_BURST, IO_START = 0, IO_NUM = 0, CPU_BURST;
 	bool CALL_SCHEDULER = false;
 	Event* new_evt; //Avoid cross initialization
-	Process* CURRENT_RUNNING_PROCESS = NULL;
+	int CURRENT_RUNNING_PROCESS = -1; //slot, -1 when the CPU is idle
+	ProcessTable &procs = *table;
 	
+	if(!restore_file.empty()) {
+		Checkpoint ck(restore_file, false, 'S');
+		snapshot(ck, sche, IO_START, IO_NUM, CALL_SCHEDULER, CURRENT_RUNNING_PROCESS);
+		ck.close();
+	}
+	long resumed_at = events_done;
 	while((evt = get_event())) {
-		Process *proc = evt->proc; // this is the process the event works on
+		if(checkpoint_every > 0 && events_done % checkpoint_every == 0 && events_done != resumed_at) {
+			Checkpoint ck(checkpoint_file, true, 'S');
+			snapshot(ck, sche, IO_START, IO_NUM, CALL_SCHEDULER, CURRENT_RUNNING_PROCESS);
+			ck.close();
+		}
+		events_done++;
+		int proc = evt->proc; // this is the process the event works on
 		int CURRENT_TIME = evt->time_stamp;
-		proc->timeInPrevState = CURRENT_TIME - proc->state_ts;
+		if(stats != NULL)
+			stats->advance(CURRENT_TIME, CURRENT_RUNNING_PROCESS >= 0, IO_NUM > 0);
+		if(evt->transition != TRANS_TO_UNTHROTTLE && evt->transition != TRANS_TO_IO_IDLE) {
+			procs.timeInPrevState[proc] = CURRENT_TIME - procs.state_ts[proc];
+			TRACE_STATE(proc, CURRENT_TIME, transition_names[evt->transition]);
+		}
 		
 		switch(evt->transition) { // which state to transition to?
 			case TRANS_TO_READY:
 				// must come from BLOCKED or from PREEMPTION
 				// must add to run queue
-				//if(proc->state == STATE_CREATED)
+				//if(procs.state[proc] == STATE_CREATED)
 					//printv(vout, evt, CURRENT_TIME, 0);
-				proc->state = STATE_READY;
+				if(procs.state[proc] == STATE_CREATED && workload != NULL && !workload->closed)
+					generate();
+				procs.state[proc] = STATE_READY;
 				sche->add_process(proc); //2
+				if(stats != NULL)
+					stats->enqueued();
 				CALL_SCHEDULER = true; // conditional on whether something is run
 			break;
 			
-			case TRANS_TO_RUN:
+			case TRANS_TO_RUN: {
 				// create event for either preemption or blocking
-				proc->TC_remain -= proc->timeInPrevState;
-				if(proc->TC_remain > 0) { //not finished
-					proc->CB_remain -= proc->timeInPrevState;
-					if(proc->CB_remain > 0) {
+				int ran = power != NULL ? power->work : procs.timeInPrevState[proc]; //work done at full speed
+				procs.TC_remain[proc] -= ran;
+				if(procs.TC_remain[proc] > 0) { //not finished
+					procs.CB_remain[proc] -= ran;
+					if(procs.CB_remain[proc] > 0) {
 						//cpu burst not finished, preempted
 						new_evt = new Event(proc, CURRENT_TIME, TRANS_TO_PREEMPT); //5
 						put_event(new_evt);
 						//change current process state
-						proc->state_ts = CURRENT_TIME;
+						procs.state_ts[proc] = CURRENT_TIME;
 						//printv(vout, new_evt, CURRENT_TIME, 0);
-						proc->state = STATE_READY;
+						procs.state[proc] = STATE_READY;
 					}
 					else {
 						//cpu burst finished, to i/o burst
-						IO_BURST = myrandom(proc->IO); //random number between [1...IO]
-						proc->IT += IO_BURST;
-						new_evt = new Event(proc, CURRENT_TIME + IO_BURST, TRANS_TO_BLOCK); //3
-						put_event(new_evt);
+						IO_BURST = myrandom(procs.IO[proc]); //random number between [1...IO]
+						if(replay != NULL)
+							replay->bursts[proc].push_back(IO_BURST);
+						if(devices.empty()) {
+							procs.IT[proc] += IO_BURST;
+							new_evt = new Event(proc, CURRENT_TIME + IO_BURST, TRANS_TO_BLOCK); //3
+							put_event(new_evt);
+						}
+						else //Done when its device has served it
+							submit_io(proc, CURRENT_TIME, IO_BURST);
 						//change cur proc state
-						proc->state_ts = CURRENT_TIME;
+						procs.state_ts[proc] = CURRENT_TIME;
 						//printv(vout, new_evt, CURRENT_TIME, IO_BURST);
-						proc->state = STATE_BLOCKED; 
+						procs.state[proc] = STATE_BLOCKED; 
 						if(IO_NUM == 0)
 							IO_START = CURRENT_TIME;
 						IO_NUM++; 
 					}
 				}
 				else { //finished
-					proc->state_ts = CURRENT_TIME;
-					proc->FT = CURRENT_TIME;
-					proc->TT = CURRENT_TIME - proc->AT;
-					proc->state = STATE_FINISHED;
+					procs.state_ts[proc] = CURRENT_TIME;
+					procs.FT[proc] = CURRENT_TIME;
+					procs.TT[proc] = CURRENT_TIME - procs.AT[proc];
+					procs.state[proc] = STATE_FINISHED;
 					//printv(vout, evt, CURRENT_TIME, 0);
+					if(stats != NULL) {
+						stats->TT.record(procs.TT[proc]);
+						stats->CW.record(procs.CW[proc]);
+					}
+					retire(proc);
 				}
 				CALL_SCHEDULER = true; //CALL SCHEDULER BUT NO CURRENT RUNNING PROCESS
-				CURRENT_RUNNING_PROCESS = NULL;
+				CURRENT_RUNNING_PROCESS = -1;
+				if(groups != NULL) {
+					groups->charge(procs.group[proc], CURRENT_TIME, procs.timeInPrevState[proc]);
+					for(auto g : groups->newly_throttled)
+						put_event(new Event(g, groups->period_end[g], TRANS_TO_UNTHROTTLE));
+				}
+				if(power != NULL)
+					power->idle(CURRENT_TIME);
 			break;
+			}
 			
 			case TRANS_TO_BLOCK:
 				// create an event for when process becomes READY again
 				// When a process returns from I/O its dynamic priority is reset to (static_priority-1)
-				proc->DPrio = proc->SPrio - 1;
+				procs.DPrio[proc] = procs.SPrio[proc] - 1;
+				if(!devices.empty()) { //IO time includes the wait for the device
+					procs.IT[proc] += procs.timeInPrevState[proc];
+					complete_io(proc, CURRENT_TIME);
+				}
 				new_evt = new Event(proc, CURRENT_TIME, TRANS_TO_READY); //4
 				put_event(new_evt);
-				proc->state_ts = CURRENT_TIME;
+				procs.state_ts[proc] = CURRENT_TIME;
 				//printv(vout, new_evt, CURRENT_TIME, 0);
-				proc->state = STATE_READY;
+				procs.state[proc] = STATE_READY;
 				IO_NUM--;
 				if(IO_NUM == 0) //compute total io time
 					totalIT += (CURRENT_TIME - IO_START);
@@ -483,16 +1908,33 @@ void DES::Simulation(string infile, string rfile, string scheAlg, int time_quant
 			case TRANS_TO_PREEMPT:
 				// add to runqueue (no event is generated)
 				// With every quantum expiration the dynamic priority decreases by one.
-				proc->DPrio--;
+				procs.DPrio[proc]--;
 				sche->add_process(proc); //2
+				if(stats != NULL)
+					stats->enqueued();
 				//add to runqueue first so that sche can add it into expired queue
-				if(proc->DPrio == -1) //When "-1" is reached the prio is reset to (static_priority-1).
-					proc->DPrio = proc->SPrio - 1;
+				if(procs.DPrio[proc] == -1) //When "-1" is reached the prio is reset to (static_priority-1).
+					procs.DPrio[proc] = procs.SPrio[proc] - 1;
+				CALL_SCHEDULER = true;
+			break;
+			
+			case TRANS_TO_UNTHROTTLE:
+				// the quota of the group is refilled at its period end
+				if(!groups->unthrottle(proc, CURRENT_TIME))
+					put_event(new Event(proc, groups->period_end[proc], TRANS_TO_UNTHROTTLE));
 				CALL_SCHEDULER = true;
 			break;
+			
+			case TRANS_TO_IO_IDLE:
+				// the device looks again for a request to serve, unless one arrived and started meanwhile
+				devices[proc]->idle_event = false;
+				if(devices[proc]->active == NULL)
+					started_io(proc, devices[proc]->dispatch(CURRENT_TIME), CURRENT_TIME);
+			break;
 		}
 		//remove current event object from Memory
 		delete_event();
+		delete evt;
 		evt = NULL;
 		
 		if(CALL_SCHEDULER) {
@@ -500,18 +1942,25 @@ void DES::Simulation(string infile, string rfile, string scheAlg, int time_quant
 				continue; //process next event from event queue
 			}
 			CALL_SCHEDULER = false;
-			if(CURRENT_RUNNING_PROCESS == NULL) {
+			if(CURRENT_RUNNING_PROCESS < 0) {
 				CURRENT_RUNNING_PROCESS = sche->get_next_process();
-				if(CURRENT_RUNNING_PROCESS == NULL) {
+				if(CURRENT_RUNNING_PROCESS < 0) {
 					continue;
 				}
+				if(stats != NULL) {
+					stats->dequeued();
+					if(procs.TC_remain[CURRENT_RUNNING_PROCESS] == procs.TC[CURRENT_RUNNING_PROCESS]) //first dispatch
+						stats->RT.record(CURRENT_TIME - procs.AT[CURRENT_RUNNING_PROCESS]);
+				}
 				//Is cpu burst finished?
-				if(CURRENT_RUNNING_PROCESS->CB_remain == 0) {
+				if(procs.CB_remain[CURRENT_RUNNING_PROCESS] == 0) {
 					//get a new random number
-					int new_cb = myrandom(CURRENT_RUNNING_PROCESS->CB); //a random number between [1..CB]
-					if(new_cb > CURRENT_RUNNING_PROCESS->TC_remain)
-						new_cb = CURRENT_RUNNING_PROCESS->TC_remain;
-					CURRENT_RUNNING_PROCESS->CB_remain = new_cb;
+					int new_cb = myrandom(procs.CB[CURRENT_RUNNING_PROCESS]); //a random number between [1..CB]
+					if(new_cb > procs.TC_remain[CURRENT_RUNNING_PROCESS])
+						new_cb = procs.TC_remain[CURRENT_RUNNING_PROCESS];
+					procs.CB_remain[CURRENT_RUNNING_PROCESS] = new_cb;
+					if(replay != NULL)
+						replay->bursts[CURRENT_RUNNING_PROCESS].push_back(new_cb);
 					if(new_cb > time_quant) { //treat preemption
 						CPU_BURST = time_quant; 
 					}
@@ -520,67 +1969,291 @@ void DES::Simulation(string infile, string rfile, string scheAlg, int time_quant
 				}
 				else {
 					//continue the previous process
-					if(CURRENT_RUNNING_PROCESS->CB_remain > time_quant)
+					if(procs.CB_remain[CURRENT_RUNNING_PROCESS] > time_quant)
 						CPU_BURST = time_quant;
 					else
-						CPU_BURST = CURRENT_RUNNING_PROCESS->CB_remain;
+						CPU_BURST = procs.CB_remain[CURRENT_RUNNING_PROCESS];
+				}
+				if(groups != NULL) //Cut short where a quota runs out
+					CPU_BURST = min(CPU_BURST, groups->cap(procs.group[CURRENT_RUNNING_PROCESS], CURRENT_TIME));
+				if(power != NULL) { //Wall time of the burst at the chosen frequency
+					CPU_BURST = power->dispatch(CURRENT_TIME, CPU_BURST);
+					procs.energy[CURRENT_RUNNING_PROCESS] += power->burst_energy;
 				}
 				// create event to make process runnable for same time.
 				new_evt = new Event(CURRENT_RUNNING_PROCESS, CURRENT_TIME + CPU_BURST, TRANS_TO_RUN);
 				put_event(new_evt);
-				CURRENT_RUNNING_PROCESS->timeInPrevState = CURRENT_TIME - CURRENT_RUNNING_PROCESS->state_ts;
-				CURRENT_RUNNING_PROCESS->state_ts = CURRENT_TIME;
-				CURRENT_RUNNING_PROCESS->state = STATE_RUNNING;
-				CURRENT_RUNNING_PROCESS->CW += CURRENT_RUNNING_PROCESS->timeInPrevState; //CPU Waiting time (time in Ready state)
+				TRACE_STATE(CURRENT_RUNNING_PROCESS, CURRENT_TIME, "DISPATCH");
+				procs.timeInPrevState[CURRENT_RUNNING_PROCESS] = CURRENT_TIME - procs.state_ts[CURRENT_RUNNING_PROCESS];
+				procs.state_ts[CURRENT_RUNNING_PROCESS] = CURRENT_TIME;
+				procs.state[CURRENT_RUNNING_PROCESS] = STATE_RUNNING;
+				procs.CW[CURRENT_RUNNING_PROCESS] += procs.timeInPrevState[CURRENT_RUNNING_PROCESS]; //CPU Waiting time (time in Ready state)
 			}
 		}
 	}
-	printSummary();
+}
+
+//Everything the event loop depends on between two events: the processes, the event queue in order, the runqueue,
+//the random cursor and the IO accounting. The random numbers themselves are read again from the same rfile.
+template<class Sched>
+void DES::snapshot(Checkpoint &ck, Sched* sche, int &io_start, int &io_num, bool &call_scheduler, int &running) {
+	char ck_alg = alg;
+	int ck_rcount = rcount;
+	ck.io(ck_alg);
+	ck.io(ck_rcount);
+	if(ck_alg != alg)
+		ck.fail("written with another scheduler");
+	if(ck_rcount != rcount)
+		ck.fail("written with another random file");
+	ck.io(rofs);
+	ck.io(pid);
+	ck.io(totalIT);
+	ck.io(events_done);
+	ck.io(io_start);
+	ck.io(io_num);
+	ck.io(call_scheduler);
+	table->checkpoint(ck);
+	ck.io(running);
+	long ck_interval = stats_interval;
+	ck.io(ck_interval);
+	if(ck_interval != stats_interval)
+		ck.fail("written with another statistics interval");
+	if(stats != NULL)
+		stats->checkpoint(ck);
+	long ck_devices = devices.size();
+	char ck_io[2] = {io_alg.empty() ? (char)0 : io_alg[0], io_model.empty() ? (char)0 : io_model[0]};
+	ck.io(ck_devices);
+	ck.io(ck_io);
+	if(ck_devices != (long)devices.size() || ck_io[0] != (io_alg.empty() ? 0 : io_alg[0]) || ck_io[1] != (io_model.empty() ? 0 : io_model[0]))
+		ck.fail("written with other devices");
+	ck.io(io_id);
+	long num_ios = inflight.size();
+	ck.io(num_ios);
+	auto entry = inflight.begin();
+	if(!ck.saving)
+		inflight.clear();
+	for(long i = 0; i < num_ios; i++) {
+		BurstIO* io = ck.saving ? (entry++)->second : new BurstIO(0, 0, 0, 0, 0);
+		ck.io(io->index);
+		ck.io(io->arrival_time);
+		ck.io(io->track);
+		ck.io(io->tenant);
+		ck.io(io->weight);
+		ck.io(io->proc);
+		ck.io(io->burst);
+		ck.io(io->start_time);
+		ck.io(io->end_time);
+		if(!ck.saving)
+			inflight[io->index] = io;
+	}
+	Index<BurstIO> ios;
+	ios.id_of = [](BurstIO* io) { return (long)io->index; };
+	ios.at = [&](long id) { return inflight.at(id); };
+	for(auto dev : devices)
+		dev->checkpoint(ck, ios);
+	char ck_governor = governor;
+	ck.io(ck_governor);
+	if(ck_governor != governor)
+		ck.fail("written with another governor");
+	if(power != NULL)
+		power->checkpoint(ck);
+	char ck_groups = groups != NULL;
+	ck.io(ck_groups);
+	if(ck_groups != (groups != NULL))
+		ck.fail("written with other control groups");
+	if(groups != NULL)
+		groups->checkpoint(ck);
+	long num_events = event_list.size();
+	ck.io(num_events);
+	if(!ck.saving)
+		event_list.clear();
+	auto it = event_list.begin();
+	for(long i = 0; i < num_events; i++) {
+		Event* event = ck.saving ? *it++ : new Event(0, 0, TRANS_TO_READY);
+		ck.io(event->time_stamp);
+		ck.io(event->transition);
+		ck.io(event->proc);
+		if(!ck.saving)
+			event_list.push_back(event);
+	}
+	sche->checkpoint(ck);
 }
 
 void DES::printSummary() {
-	for(auto proc : proc_list) {
-		if(proc->FT > FINISH_TIME)	FINISH_TIME = proc->FT;
-		totalTC += proc->TC;
-		totalCW += proc->CW;
-		totalTT += proc->TT;
-		printf("%04d: %4d %4d %4d %4d %1d | %5d %5d %5d %5d\n", proc->pid, proc->AT, proc->TC, proc->CB, proc->IO, proc->SPrio,
-				proc->FT, proc->TT, proc->IT, proc->CW);
-	}
-	CPU_UTIL = (double) totalTC / FINISH_TIME * 100; //percentage (0.0 C 100.0) of time at least one process is running
-	IO_UTIL = (double) totalIT / FINISH_TIME * 100; //percentage (0.0 C 100.0) of time at least one process is performing IO
-	AVG_TT = (double) totalTT / proc_list.size();
-	AVG_CW = (double) totalCW / proc_list.size();
-	THROUGHPUT = (double) proc_list.size() / FINISH_TIME * 100; //Throughput of number processes per 100 time units
+	ProcessTable &procs = *table;
+	for(int proc = 0; workload == NULL && proc < procs.size(); proc++) {
+		printf("%04d: %4d %4d %4d %4d %1d | %5d %5d %5d %5d", procs.pid[proc], procs.AT[proc], procs.TC[proc], procs.CB[proc],
+				procs.IO[proc], procs.SPrio[proc], procs.FT[proc], procs.TT[proc], procs.IT[proc], procs.CW[proc]);
+		if(power != NULL) //mJ
+			printf(" %8.2lf", procs.energy[proc] / 1000.0);
+		printf("\n");
+	}
+	summarize();
 	printf("SUM: %d %.2lf %.2lf %.2lf %.2lf %.3lf\n", FINISH_TIME, CPU_UTIL, IO_UTIL, AVG_TT, AVG_CW, THROUGHPUT);
+	//Requests served, share of the time busy, mean and longest wait in the queue per device
+	for(int k = 0; k < (int)devices.size(); k++)
+		printf("IODEV[%d]: N=%ld UTIL=%.2lf WAIT=%.2lf MAXWAIT=%d\n", k, devices[k]->served,
+				(double)devices[k]->busy / FINISH_TIME * 100, devices[k]->served ? (double)devices[k]->wait / devices[k]->served : 0.0,
+				devices[k]->max_wait);
+	if(power != NULL) {
+		//Energy in mJ (running, idle, waking up), mean power in W, processes finished per J
+		double total = energy();
+		printf("ENERGY: %.2lf %.2lf %.2lf %.2lf %.3lf %.3lf\n", total / 1000, power->active_energy / 1000.0,
+				power->idle_energy / 1000.0, power->wake_energy / 1000.0, total / FINISH_TIME / cpus / 1000, num_finished / (total / 1e6));
+		//Share of the time in each P-state and C-state, over the CPUs
+		printf("RESIDENCY:");
+		for(int p = 0; p < NUM_PSTATES; p++)
+			printf(" P%d=%.2lf", p, (double)power->p_time[p] / FINISH_TIME / cpus * 100);
+		for(int c = 0; c < NUM_CSTATES; c++)
+			printf(" %s=%.2lf", cstates[c].name, (double)power->c_time[c] / FINISH_TIME / cpus * 100);
+		printf("\n");
+	}
+	//Per group: weight, quota/period, CPU time, share of the time it competed with its siblings against the share by
+	//the weights, time throttled and how often, descendants included
+	for(int g = 0; groups != NULL && g < groups->size(); g++) {
+		long long contended = g > 0 ? groups->contended_time[groups->parent[g]] : 0;
+		printf("GROUP[%s]: W=%d Q=%d/%d RUN=%lld SHARE=%.2lf FAIR=%.2lf THR=%lld NTHR=%d\n", g == 0 ? "/" : groups->path[g].c_str(),
+				groups->weight[g], groups->quota[g], groups->quota[g] > 0 ? groups->period[g] : 0, groups->run_time[g],
+				g == 0 ? 100.0 : contended > 0 ? (double)groups->share_time[g] / contended * 100 : 0.0,
+				g == 0 ? 100.0 : contended > 0 ? groups->fair_time[g] / contended * 100 : 0.0, groups->throttled_time[g],
+				groups->throttles[g]);
+	}
+}
+
+double DES::energy() {
+	return (double)power->active_energy + power->idle_energy + power->wake_energy;
+}
+
+//Totals over the processes and the figures of the SUM line, generated processes have been accounted for by retire()
+void DES::summarize() {
+	ProcessTable &procs = *table;
+	for(int proc = 0; workload == NULL && proc < procs.size(); proc++) {
+		if(procs.FT[proc] > FINISH_TIME)	FINISH_TIME = procs.FT[proc];
+		totalTC += procs.TC[proc];
+		totalCW += procs.CW[proc];
+		totalTT += procs.TT[proc];
+		num_finished++;
+	}
+	long long busy = totalTC;
+	if(power != NULL) { //The CPUs were busy for the wall time of the bursts, at their P-states and with the wake-ups
+		busy = 0;
+		for(int p = 0; p < NUM_PSTATES; p++)
+			busy += power->p_time[p];
+	}
+	CPU_UTIL = (double) busy / FINISH_TIME / cpus * 100; //percentage (0.0 C 100.0) of time at least one process is running
+	IO_UTIL = (double) totalIT / FINISH_TIME / cpus * 100; //percentage (0.0 C 100.0) of time at least one process is performing IO
+	//With several CPUs both are their mean over the CPUs
+	AVG_TT = (double) totalTT / num_finished;
+	AVG_CW = (double) totalCW / num_finished;
+	THROUGHPUT = (double) num_finished / FINISH_TIME * 100; //Throughput of number processes per 100 time units
+}
+
+//Scheduler and quantum of one -s argument
+void parse_scheduler(string str, string &alg, int &tq) {
+	if(str[0] == 'R' || str[0] == 'P') {
+		alg = str.substr(0, 1);
+		tq = atoi(str.substr(1).c_str());
+	}
+	else if(str[0] == 'F' || str[0] == 'L' || str[0] == 'S') {
+		alg = str;
+		tq = INT_MAX;
+	}
+	else
+		alg = str; //rejected by Simulation
 }
 
 int main(int argc, char* argv[]) {
 	string str, alg;
 	bool vout = 0;
-	int c, tq;
-	while((c = getopt(argc, argv, "vs:")) != -1) {
+	int c, tq, sweep_threads = max((int)thread::hardware_concurrency(), 1);
+	vector<string> sweep_algs;
+	vector<int> sweep_quanta;
+	DES sim;
+	while((c = getopt(argc, argv, "vs:G:t:c:R:p:S:j:i:d:m:e:g:x:")) != -1) {
 		switch(c) {
 	 		case 'v':
 	 			vout = 1;
 	 			break;
 	 		case 's': //-s[ FLS | R<num> | P<num> ]
-	 			str = optarg;
-	 			if(str[0] == 'R' || str[0] == 'P') {
-	 				alg = str.substr(0, 1);
-	 				tq = atoi(str.substr(1).c_str());
-				}
-				else if(str[0] == 'F' || str[0] == 'L' || str[0] == 'S') {
-					alg = str;
-					tq = INT_MAX;
+	 			parse_scheduler(optarg, alg, tq);
+	 			break;
+			case 'S': { //-S<list> sweep over comma separated schedulers, e.g. -SF,R2,R4,P4
+				stringstream split(optarg);
+				while(getline(split, str, ',')) {
+					if(str.empty())
+						continue;
+					parse_scheduler(str, alg, tq);
+					sweep_algs.push_back(str[0] == 'R' || str[0] == 'P' ? alg : str);
+					sweep_quanta.push_back(tq);
 				}
+				break;
+			}
+			case 'j': //-j<threads> threads of the sweep
+				sweep_threads = max(atoi(optarg), 1);
+				break;
+			case 'G': //-G<workload> generate the processes, see workload.h
+				sim.workload_spec = optarg;
+				break;
+			case 't': //-t<file> write a Chrome trace of the process states (needs -DDES_TRACE)
+				sim.trace_file = optarg;
+				break;
+			case 'c': { //-c<events>:<file> checkpoint every so many events
+				char path[4096];
+				if(sscanf(optarg, "%ld:%4095s", &sim.checkpoint_every, path) == 2)
+					sim.checkpoint_file = path;
 				else
-					break;
-	 			break;
+					sim.checkpoint_every = 0;
+				break;
+			}
+			case 'i': //-i<interval> print live statistics every interval time units
+				sim.stats_interval = max(atol(optarg), 0L);
+				break;
+			case 'd': { //-d<iosched>[:<devices>] blocked processes queue for devices served in the order of an IO scheduler
+				char ioalg[16];
+				sim.io_devices = 1;
+				if(sscanf(optarg, "%15[^:]:%d", ioalg, &sim.io_devices) >= 1)
+					sim.io_alg = ioalg;
+				sim.io_devices = max(sim.io_devices, 1);
+				break;
+			}
+			case 'm': //-m<model> disk model of the devices, see iosched.h
+				sim.io_model = optarg;
+				break;
+			case 'e': //-e<governor> energy and frequency model run by the governor
+				sim.governor = optarg[0];
+				break;
+			case 'g': //-g<file> control groups, see CGroups
+				sim.group_file = optarg;
+				break;
+			case 'x': //-x<us>[:<policy>[:<cpu>]] replay the processes as threads on the host, see Replay
+				sim.replay_spec = optarg;
+				break;
+			case 'R': //-R<file> resume from a checkpoint instead of reading the input file
+				sim.restore_file = optarg;
+				break;
+			case 'p': //-p<cpus>[:<threads>] partitioned mode, processes pinned to cpus CPUs simulated on threads threads
+				sim.threads = 0;
+				sscanf(optarg, "%d:%d", &sim.cpus, &sim.threads);
+				sim.cpus = max(sim.cpus, 1);
+				if(sim.threads <= 0)
+					sim.threads = max((int)thread::hardware_concurrency(), 1);
+				break;
 		 }
 	}
-	string infile = argv[optind];
-	string rfile = argv[optind + 1];
-	DES sim;
+	string infile, rfile;
+	if(!sweep_algs.empty()) {
+		if(!sim.workload_spec.empty() || sim.checkpoint_every > 0 || !sim.restore_file.empty() || !sim.trace_file.empty()
+				|| sim.cpus > 1 || sim.stats_interval > 0 || !sim.replay_spec.empty()) {
+			fprintf(stderr, "a sweep replays an input file on one CPU, without checkpoints, traces, live statistics or a replay on the host\n");
+			exit(1);
+		}
+		sim.threads = sweep_threads;
+		infile = argv[optind++];
+		sim.Sweep(infile, argv[optind], sweep_algs, sweep_quanta);
+		return 0;
+	}
+	if(sim.workload_spec.empty() && sim.restore_file.empty())
+		infile = argv[optind++];
+	rfile = argv[optind];
 	sim.Simulation(infile, rfile, alg, tq, vout);
 } 
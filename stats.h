@@ -0,0 +1,97 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <array>
+#include <climits>
+#include "checkpoint.h"
+using namespace std;
+
+//Streaming percentiles in constant memory
+//A log-linear histogram in the manner of HdrHistogram: values below 2 * SUB are counted exactly, above that every
+//power of two is split into SUB buckets of equal width, so a percentile is within 1 / SUB of the value it stands for.
+//The counters cover every non-negative long long, values below zero are counted as zero.
+class Histogram {
+	public:
+		static const int SUB_BITS = 5;
+		static const int SUB = 1 << SUB_BITS;
+		Histogram();
+		void record(long long v);
+		long long count();
+		double mean();
+		long long max();
+		long long percentile(double p); //highest value of the bucket that holds the p-th percentile
+		void checkpoint(Checkpoint &ck);
+	private:
+		array<long long, (64 - SUB_BITS) * SUB> buckets;
+		long long total, sum, largest;
+		int bucket(long long v);
+		long long highest(int b);
+};
+
+Histogram::Histogram() {
+	buckets.fill(0);
+	total = 0;
+	sum = 0;
+	largest = 0;
+}
+
+int Histogram::bucket(long long v) {
+	if(v < 2 * SUB)
+		return (int)v;
+	int shift = 63 - __builtin_clzll(v) - SUB_BITS;
+	return shift * SUB + (int)(v >> shift);
+}
+
+long long Histogram::highest(int b) {
+	if(b < 2 * SUB)
+		return b;
+	int shift = b / SUB - 1;
+	long long low = (long long)(b % SUB + SUB) << shift;
+	return low + ((1LL << shift) - 1);
+}
+
+void Histogram::record(long long v) {
+	if(v < 0)
+		v = 0;
+	buckets[bucket(v)]++;
+	total++;
+	sum += v;
+	if(v > largest)
+		largest = v;
+}
+
+long long Histogram::count() {
+	return total;
+}
+
+double Histogram::mean() {
+	return total == 0 ? 0.0 : (double)sum / total;
+}
+
+long long Histogram::max() {
+	return largest;
+}
+
+long long Histogram::percentile(double p) {
+	if(total == 0)
+		return 0;
+	long long rank = (long long)(p / 100 * total + 0.5);
+	if(rank < 1)
+		rank = 1;
+	long long seen = 0;
+	for(int b = 0; b < (int)buckets.size(); b++) {
+		seen += buckets[b];
+		if(seen >= rank)
+			return min(highest(b), largest);
+	}
+	return largest;
+}
+
+void Histogram::checkpoint(Checkpoint &ck) {
+	ck.io(buckets);
+	ck.io(total);
+	ck.io(sum);
+	ck.io(largest);
+}
+
+#endif
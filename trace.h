@@ -0,0 +1,115 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <cstdio>
+#include <cstddef>
+#include <atomic>
+#include <vector>
+using namespace std;
+
+//Timeline tracing in the Chrome trace event format (chrome://tracing, ui.perfetto.dev)
+//Probes push fixed size records into a single producer single consumer ring, the exporter drains it into the
+//JSON file whenever it fills up and at close, so a trace of any length runs in constant memory.
+//Simulation ticks are written as microseconds. Every lane is a thread of one trace process.
+#define TRACE_RING 4096 //records, a power of two
+
+struct TraceRecord {
+	int ts; //start
+	int dur;
+	int lane;
+	const char* name; //static strings only, the ring does not own them
+	const char* arg;
+};
+
+class TraceRing {
+	public:
+		TraceRing();
+		bool push(const TraceRecord &r); //false if full
+		bool pop(TraceRecord &r); //false if empty
+	private:
+		TraceRecord buf[TRACE_RING];
+		atomic<size_t> head, tail; //head is written by the producer only, tail by the consumer only
+};
+
+TraceRing::TraceRing() {
+	head.store(0);
+	tail.store(0);
+}
+
+bool TraceRing::push(const TraceRecord &r) {
+	size_t h = head.load(memory_order_relaxed);
+	if(h - tail.load(memory_order_acquire) == TRACE_RING)
+		return false;
+	buf[h & (TRACE_RING - 1)] = r;
+	head.store(h + 1, memory_order_release);
+	return true;
+}
+
+bool TraceRing::pop(TraceRecord &r) {
+	size_t t = tail.load(memory_order_relaxed);
+	if(t == head.load(memory_order_acquire))
+		return false;
+	r = buf[t & (TRACE_RING - 1)];
+	tail.store(t + 1, memory_order_release);
+	return true;
+}
+
+class ChromeTrace {
+	public:
+		ChromeTrace(const char* path, const char* lane_prefix);
+		void record(int ts, int dur, int lane, const char* name, const char* arg);
+		void close();
+	private:
+		FILE* out;
+		TraceRing ring;
+		const char* prefix;
+		vector<bool> named; //lanes that got their thread_name
+		bool first;
+		void drain();
+};
+
+ChromeTrace::ChromeTrace(const char* path, const char* lane_prefix) {
+	out = fopen(path, "w");
+	if(out == NULL)
+		perror(path);
+	else
+		fprintf(out, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+	prefix = lane_prefix;
+	first = true;
+}
+
+void ChromeTrace::record(int ts, int dur, int lane, const char* name, const char* arg) {
+	TraceRecord r = {ts, dur, lane, name, arg};
+	while(!ring.push(r))
+		drain();
+}
+
+void ChromeTrace::drain() {
+	TraceRecord r;
+	while(ring.pop(r)) {
+		if(out == NULL)
+			continue;
+		if(r.lane >= (int)named.size())
+			named.resize(r.lane + 1, false);
+		if(!named[r.lane]) {
+			named[r.lane] = true;
+			fprintf(out, "%s\n{\"ph\":\"M\",\"pid\":0,\"tid\":%d,\"name\":\"thread_name\",\"args\":{\"name\":\"%s %d\"}}",
+					first ? "" : ",", r.lane, prefix, r.lane);
+			first = false;
+		}
+		fprintf(out, "%s\n{\"ph\":\"X\",\"pid\":0,\"tid\":%d,\"ts\":%d,\"dur\":%d,\"name\":\"%s\",\"args\":{\"event\":\"%s\"}}",
+				first ? "" : ",", r.lane, r.ts, r.dur, r.name, r.arg);
+		first = false;
+	}
+}
+
+void ChromeTrace::close() {
+	drain();
+	if(out == NULL)
+		return;
+	fprintf(out, "\n]}\n");
+	fclose(out);
+	out = NULL;
+}
+
+#endif
@@ -0,0 +1,170 @@
+#ifndef WORKLOAD_H
+#define WORKLOAD_H
+
+#include <string>
+#include <sstream>
+#include <map>
+#include <vector>
+#include <queue>
+#include <random>
+#include <cmath>
+#include <algorithm>
+using namespace std;
+
+//Synthetic workload generator shared by the IO scheduler and the process scheduler
+//Events are drawn one at a time from a seeded generator, nothing is materialized, so a run of 10^8 events needs no input file.
+//The workload is described by a comma separated key=value list, e.g. "n=1000000,arrival=mmpp,gap=20,bgap=2,dist=zipf,seed=7".
+//	n			events to generate
+//	arrival		poisson | mmpp | closed
+//	gap			mean ticks between arrivals (poisson, calm state of mmpp)
+//	bgap		mean ticks between arrivals in the bursty state of mmpp
+//	dwell		mean ticks spent in an mmpp state before switching
+//	clients		closed loop clients, each waits for its event to finish before thinking and issuing the next
+//	think		mean think time of a closed loop client
+//	dist		uniform | zipf | seq, distribution of the sampled values (tracks, CPU bursts)
+//	skew		zipf exponent
+//	streams		concurrent sequential streams, a stream jumps to a random place with probability jump
+//	seed		random seed
+class Workload {
+	public:
+		long count, generated;
+		bool closed;
+		Workload(string spec);
+		double get(string key, double def);
+		string get(string key, string def);
+		//Open loop: time of the next arrival
+		long next_arrival();
+		//Closed loop: clients ready to issue at the given time, earliest first
+		void client_ready(int client, long now);
+		bool client_pending();
+		pair<long, int> next_client();
+		//A value in [0, range), consecutive calls of one sequential stream advance by step
+		long sample(long range, int step);
+		long uniform(long lo, long hi);
+		double exponential(double mean);
+		bool chance(double p);
+	private:
+		map<string, string> kv;
+		mt19937_64 rng;
+		string dist;
+		double gap, bgap, dwell, think, skew, jump;
+		bool burst; //mmpp state
+		double clock, state_end;
+		priority_queue<pair<long, int>, vector<pair<long, int>>, greater<pair<long, int>>> ready; //<time, client>
+		vector<long> cursor; //sequential streams
+		map<long, vector<double>> zipf_cdf; //by range
+		long zipf(long range);
+};
+
+Workload::Workload(string spec) {
+	stringstream split(spec);
+	string item;
+	while(getline(split, item, ',')) {
+		size_t eq = item.find('=');
+		if(eq != string::npos)
+			kv[item.substr(0, eq)] = item.substr(eq + 1);
+	}
+	count = (long)get("n", 1000.0);
+	generated = 0;
+	rng.seed((unsigned long)get("seed", 1.0));
+	string arrival = get("arrival", "poisson");
+	closed = arrival == "closed";
+	dist = get("dist", "uniform");
+	gap = get("gap", 10.0);
+	bgap = arrival == "mmpp" ? get("bgap", gap / 10) : gap;
+	dwell = get("dwell", 1000.0);
+	think = get("think", gap);
+	skew = get("skew", 0.99);
+	jump = get("jump", 0.01);
+	cursor.assign((int)get("streams", 4.0), -1);
+	burst = false;
+	clock = 0;
+	state_end = exponential(dwell);
+	if(closed) {
+		int clients = (int)get("clients", 8.0);
+		for(int i = 0; i < clients; i++)
+			client_ready(i, 0);
+	}
+}
+
+double Workload::get(string key, double def) {
+	auto it = kv.find(key);
+	return it == kv.end() ? def : atof(it->second.c_str());
+}
+
+string Workload::get(string key, string def) {
+	auto it = kv.find(key);
+	return it == kv.end() ? def : it->second;
+}
+
+double Workload::exponential(double mean) {
+	return exponential_distribution<double>(1.0 / mean)(rng);
+}
+
+long Workload::uniform(long lo, long hi) {
+	return uniform_int_distribution<long>(lo, hi)(rng);
+}
+
+bool Workload::chance(double p) {
+	return uniform_real_distribution<double>(0.0, 1.0)(rng) < p;
+}
+
+//Poisson arrivals, the mmpp alternates between the calm and the bursty rate after exponential dwell times
+long Workload::next_arrival() {
+	double next = clock + exponential(burst ? bgap : gap);
+	while(bgap != gap && next > state_end) { //Memoryless: restart the interval at the switch
+		clock = state_end;
+		burst = !burst;
+		state_end = clock + exponential(dwell);
+		next = clock + exponential(burst ? bgap : gap);
+	}
+	clock = next;
+	generated++;
+	return 1 + (long)clock;
+}
+
+void Workload::client_ready(int client, long now) {
+	ready.push(make_pair(now + 1 + (long)exponential(think), client));
+}
+
+bool Workload::client_pending() {
+	return !ready.empty();
+}
+
+pair<long, int> Workload::next_client() {
+	pair<long, int> next = ready.top();
+	ready.pop();
+	generated++;
+	return next;
+}
+
+//Inverse transform over the cumulative weights 1/k^skew, built once per range
+long Workload::zipf(long range) {
+	vector<double> &cdf = zipf_cdf[range];
+	if(cdf.empty()) {
+		double sum = 0;
+		cdf.reserve(range);
+		for(long k = 1; k <= range; k++) {
+			sum += 1.0 / pow((double)k, skew);
+			cdf.push_back(sum);
+		}
+	}
+	double u = uniform_real_distribution<double>(0.0, cdf.back())(rng);
+	return lower_bound(cdf.begin(), cdf.end(), u) - cdf.begin();
+}
+
+long Workload::sample(long range, int step) {
+	if(dist == "zipf")
+		return zipf(range);
+	if(dist == "seq") {
+		long &pos = cursor[uniform(0, cursor.size() - 1)];
+		if(pos < 0 || chance(jump))
+			pos = uniform(0, range - 1);
+		long value = pos;
+		pos = (pos + step) % range;
+		return value;
+	}
+	return uniform(0, range - 1);
+}
+
+#endif